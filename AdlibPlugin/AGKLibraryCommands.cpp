@@ -1,7 +1,7 @@
 #include "AGKLibraryCommands.h"
 
 char*(*AGKCommand0)( unsigned int ) = 0;
-//void(*AGKCommand1)( char* ) = 0;
+void(*AGKCommand1)( char* ) = 0;
 //float(*AGKCommand2)( float ) = 0;
 //float(*AGKCommand3)( float ) = 0;
 //float(*AGKCommand4)( float ) = 0;
@@ -1185,7 +1185,7 @@ float(*AGKCommand1178)( unsigned int, unsigned int ) = 0;
 void(*AGKCommand1182)( unsigned int, unsigned int, int ) = 0;
 void(*AGKCommand1183)( unsigned int, unsigned int, int ) = 0;
 //void(*AGKCommand1184)( unsigned int, unsigned int, float ) = 0;
-//void(*AGKCommand1185)( unsigned int, unsigned int, const char* ) = 0;
+void(*AGKCommand1185)( unsigned int, unsigned int, const char* ) = 0;
 //void(*AGKCommand1186)( unsigned int, unsigned int ) = 0;
 //unsigned int(*AGKCommand1187)( unsigned int ) = 0;
 //void(*AGKCommand1188)( unsigned int, unsigned int ) = 0;
@@ -1898,7 +1898,7 @@ extern "C" DLL_EXPORT void ReceiveAGKPtr( AGKVoidFunc ptr )
 	GetAGKFunction = (AGKVoidFunc(*)(const char*)) ptr;
 
 	AGKCommand0 = (char*(*)(unsigned int)) GetAGKFunction( "CREATESTRING_S_L" );
-	//AGKCommand1 = (void(*)(char*)) GetAGKFunction( "DELETESTRING_0_S" );
+	AGKCommand1 = (void(*)(char*)) GetAGKFunction( "DELETESTRING_0_S" );
 	//AGKCommand2 = (float(*)(float)) GetAGKFunction( "WORLDTOSCREENX_F_F" );
 	//AGKCommand3 = (float(*)(float)) GetAGKFunction( "WORLDTOSCREENY_F_F" );
 	//AGKCommand4 = (float(*)(float)) GetAGKFunction( "SCREENTOWORLDX_F_F" );
@@ -3082,7 +3082,7 @@ extern "C" DLL_EXPORT void ReceiveAGKPtr( AGKVoidFunc ptr )
 	AGKCommand1182 = (void(*)(unsigned int,unsigned int,int)) GetAGKFunction( "SETMEMBLOCKSHORT_0_L_L_L" );
 	AGKCommand1183 = (void(*)(unsigned int,unsigned int,int)) GetAGKFunction( "SETMEMBLOCKINT_0_L_L_L" );
 	//AGKCommand1184 = (void(*)(unsigned int,unsigned int,float)) GetAGKFunction( "SETMEMBLOCKFLOAT_0_L_L_F" );
-	//AGKCommand1185 = (void(*)(unsigned int,unsigned int,const char*)) GetAGKFunction( "SETMEMBLOCKSTRING_0_L_L_S" );
+	AGKCommand1185 = (void(*)(unsigned int,unsigned int,const char*)) GetAGKFunction( "SETMEMBLOCKSTRING_0_L_L_S" );
 	//AGKCommand1186 = (void(*)(unsigned int,unsigned int)) GetAGKFunction( "CREATEMEMBLOCKFROMIMAGE_0_L_L" );
 	//AGKCommand1187 = (unsigned int(*)(unsigned int)) GetAGKFunction( "CREATEMEMBLOCKFROMIMAGE_L_L" );
 	//AGKCommand1188 = (void(*)(unsigned int,unsigned int)) GetAGKFunction( "CREATEIMAGEFROMMEMBLOCK_0_L_L" );
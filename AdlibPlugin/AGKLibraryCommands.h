@@ -12,7 +12,7 @@
 //class cSprite;
 //
 extern char*(*AGKCommand0)( unsigned int );
-//extern void(*AGKCommand1)( char* );
+extern void(*AGKCommand1)( char* );
 //extern float(*AGKCommand2)( float );
 //extern float(*AGKCommand3)( float );
 //extern float(*AGKCommand4)( float );
@@ -1196,7 +1196,7 @@ extern float(*AGKCommand1178)( unsigned int, unsigned int );
 extern void(*AGKCommand1182)( unsigned int, unsigned int, int );
 extern void(*AGKCommand1183)( unsigned int, unsigned int, int );
 //extern void(*AGKCommand1184)( unsigned int, unsigned int, float );
-//extern void(*AGKCommand1185)( unsigned int, unsigned int, const char* );
+extern void(*AGKCommand1185)( unsigned int, unsigned int, const char* );
 //extern void(*AGKCommand1186)( unsigned int, unsigned int );
 //extern unsigned int(*AGKCommand1187)( unsigned int );
 //extern void(*AGKCommand1188)( unsigned int, unsigned int );
@@ -1905,7 +1905,7 @@ class agk
 {
 	public:
 		static inline char* CreateString( unsigned int size ) { return AGKCommand0( size ); }
-		//static inline void DeleteString( char* str ) { AGKCommand1( str ); }
+		static inline void DeleteString( char* str ) { AGKCommand1( str ); }
 		//static inline float WorldToScreenX( float x ) { return AGKCommand2( x ); }
 		//static inline float WorldToScreenY( float y ) { return AGKCommand3( y ); }
 		//static inline float ScreenToWorldX( float x ) { return AGKCommand4( x ); }
@@ -3089,7 +3089,7 @@ class agk
 		static inline void SetMemblockShort( unsigned int memID, unsigned int offset, int value ) { AGKCommand1182( memID, offset, value ); }
 		static inline void SetMemblockInt( unsigned int memID, unsigned int offset, int value ) { AGKCommand1183( memID, offset, value ); }
 		//static inline void SetMemblockFloat( unsigned int memID, unsigned int offset, float value ) { AGKCommand1184( memID, offset, value ); }
-		//static inline void SetMemblockString( unsigned int memID, unsigned int offset, const char* value ) { AGKCommand1185( memID, offset, value ); }
+		static inline void SetMemblockString( unsigned int memID, unsigned int offset, const char* value ) { AGKCommand1185( memID, offset, value ); }
 		//static inline void CreateMemblockFromImage( unsigned int memID, unsigned int imageID ) { AGKCommand1186( memID, imageID ); }
 		//static inline unsigned int CreateMemblockFromImage( unsigned int imageID ) { return AGKCommand1187( imageID ); }
 		//static inline void CreateImageFromMemblock( unsigned int imageID, unsigned int memID ) { AGKCommand1188( imageID, memID ); }
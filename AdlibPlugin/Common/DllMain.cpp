@@ -22,14 +22,35 @@ DllMain.cpp - Main plugin functionality exports.
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <vector>
 #include "DllMain.h"
 #include "../AGKLibraryCommands.h"
 #include "adplug.h"
 
 #include "player.h"
+#include "archive.h"
+#include "bankcache.h"
+#include "chainfprovider.h"
+#include "detect.h"
+#include "filepath.h"
+#include "library.h"
+#include "emupool.h"
+#include "mapfprovider.h"
+#include "shadowopl.h"
 #include "memfprovider.h"
 #include "memstream.h"
+#include "probe.h"
+#include "quality.h"
+#include "regdump.h"
+#include "song.h"
+#include "vgmstream.h"
+#include "worker.h"
 
 /*
 NOTE: Cannot use bool as an exported function return type because of AGK2 limitations.  Use int instead.
@@ -62,7 +83,16 @@ unsigned int clockSoundInstance = 0;
 /*
 Adlib Emulator
 */
-static Copl *opl;
+// Emulators are created here and returned here when they're done.
+static EmulatorPool emulatorPool(SOUND_SAMPLE_RATE);
+// The emulator behind the write filter.
+static ShadowOpl *opl;
+// The emulator type given to Init.  With OPL_AUTO, the emulator is chosen for each song when it starts playing.
+int initEmulator = 0;
+// Switches to cheaper emulators while rendering falls behind.
+QualityScaler qualityScaler;
+// Whether the write filter drops writes that don't change a register.
+bool filterRegisterWrites = true;
 /*
 Buffering information
 */
@@ -72,6 +102,8 @@ unsigned char *bufferPos[SOUND_BUFFER_COUNT];
 int nextBuffer = 0;
 // The time at which the next buffer should load.
 int lastClockLoopCount = 0;
+// Applied to the music after the emulator renders it.  1 is unchanged.
+float musicGain = 1.0f;
 // When this is set, the song is done looping and coming to a stop.
 int buffersUntilStop = 0;
 int framesToRender = 0;
@@ -85,9 +117,42 @@ bool musicPaused = false;
 /*
 Song list.
 */
-MemblockFileProvider fileProvider;
+// Files mapped from disk.  Memblocks hold data that was given to the plugin directly.
+MappedFileProvider mappedFileProvider;
+MemblockFileProvider memblockFileProvider;
+// Searches the mapped files and then any open archives.
+ChainFileProvider diskFileProvider({ &mappedFileProvider });
+// External data read from disk or archives is kept in memory and shared between songs.
+BankCacheFileProvider bankCache(diskFileProvider);
+// This is what the players load from.
+ChainFileProvider fileProvider({ &memblockFileProvider, &bankCache });
+/*
+Held while using the file providers, since songs can be decoded on the background worker.
+It's also the loader lock: players are only created while holding it, so no two load at once.
+*/
+std::recursive_mutex providerLock;
+// Decodes prefetched songs and scans the music library, one job at a time.
+BackgroundWorker backgroundWorker;
+// Note that the archive ID is 1-based, but the lookup is 0-based.
+std::vector<ArchiveFileProvider *> archives;
 std::vector<AgkPlayer *> songs = std::vector<AgkPlayer *>();
 AgkPlayer *currentSong = NULL;
+// The file types of the players that the last load tried, separated by commas.
+std::string lastLoadProbes;
+// Song information and durations from ScanMusicLibrary or LoadMusicLibrary.
+MusicLibrary musicLibrary;
+// When set, songs aren't decoded until they are first used.
+bool deferMusicLoading = false;
+// When set, the copies of song files are kept compressed.
+bool compressMusicSources = false;
+// Which songs are compiled into register streams when they are decoded.
+PrecompileMode precompileMusic = PRECOMPILE_NONE;
+// The folder on disk that compiled songs are saved to and loaded from, ending with a separator.  Empty when disabled.
+std::string musicStreamCache;
+// The most memory that songs should use, in bytes.  0 for no limit.
+unsigned long musicMemoryBudget = 0;
+// Incremented each time a song is used.  Songs are stamped with it for eviction.
+unsigned long long musicUseCount = 0;
 
 // Note that this also subtracts 1 from songID since the ID is 1-based, but the lookup is 0-based!
 #define ValidateSongID(songID, returnValue) \
@@ -98,6 +163,16 @@ AgkPlayer *currentSong = NULL;
 	}																			\
 	songID--
 
+static bool DecodeMusic(AgkPlayer *song);
+
+// Same as ValidateSongID, but also makes sure the song has been decoded.
+#define ValidateSongPlayer(songID, returnValue) \
+	ValidateSongID(songID, returnValue);		\
+	if (!DecodeMusic(songs[songID]))			\
+	{											\
+		return returnValue;						\
+	}
+
 // Calls the AGK Log function, but with formatting.
 void Log(char *format, ...)
 {
@@ -125,6 +200,47 @@ void ResetOPL()
 	}
 }
 
+// Puts another emulator behind the write filter, carrying over the chip's registers.  Returns false if it can't be created.
+static bool SwitchEmulator(int type)
+{
+	Copl *chip = emulatorPool.acquire(type);
+	if (!chip)
+	{
+		return false;
+	}
+	Log("Switching to emulator %d.", type);
+	emulatorPool.release(opl->getEmulator());
+	opl->setEmulator(chip);
+	return true;
+}
+
+// Goes back to the emulator given to Init, or with OPL_AUTO, to the cheapest emulator that supports the song's chip.
+static void SelectEmulator(AgkPlayer *song)
+{
+	Copl::ChipType chip = song->GetData()->getRequiredChip();
+	int type = initEmulator;
+	if (type == OPL_AUTO)
+	{
+		switch (chip)
+		{
+		case Copl::TYPE_OPL2:
+			type = OPL_DOSBOX;
+			break;
+		case Copl::TYPE_DUAL_OPL2:
+			type = OPL_DUAL;
+			break;
+		default:
+			type = OPL_NUKED;
+			break;
+		}
+	}
+	qualityScaler.start(type, chip);
+	if (emulatorPool.getType(opl->getEmulator()) != type)
+	{
+		SwitchEmulator(type);
+	}
+}
+
 int GetPlayVolume()
 {
 	if (currentSong && musicSystemVolume)
@@ -142,32 +258,22 @@ int Init(int emulator)
 		return 0;
 	}
 	agk::Log("Initializing Adlib emulator.");
-	switch (emulator)
+	if (emulator < OPL_NUKED || emulator > OPL_AUTO)
 	{
-	case OPL_NUKED:
-		opl = new CNemuopl(SOUND_SAMPLE_RATE);
-		break;
-	case OPL_DOSBOX:
-		opl = new CWemuopl(SOUND_SAMPLE_RATE, true, true);
-		break;
-	case OPL_SILVERMAN:
-		opl = new CKemuopl(SOUND_SAMPLE_RATE, true, true);
-		break;
-	case OPL_SATOH:
-		opl = new CTemuopl(SOUND_SAMPLE_RATE, true, true);
-		break;
-	case OPL_DUAL:
-		opl = new CEmuopl(SOUND_SAMPLE_RATE, true, true);
-		break;
-	default:
 		agk::PluginError("Invalid emulator type value.");
 		return 0;
 	}
-	if (!opl)
+	// With OPL_AUTO, songs are loaded against Nuked, the most capable emulator, so that players don't hold back OPL3 features.
+	// Otherwise they're loaded against the emulator that was asked for.
+	initEmulator = emulator;
+	Copl *chip = emulatorPool.acquire(emulator == OPL_AUTO ? OPL_NUKED : emulator);
+	if (!chip)
 	{
 		agk::PluginError("Failed to create Adlib emulator.");
 		return 0;
 	}
+	opl = new ShadowOpl(chip);
+	opl->setEnabled(filterRegisterWrites);
 	// Set up the sound buffer memblock.
 	agk::Log("Creating Adlib sound buffers.");
 	musicMemblockID = agk::CreateMemblock(SOUND_HEADER_LENGTH + soundBytesPerBuffer * SOUND_BUFFER_COUNT);
@@ -201,6 +307,42 @@ void WriteReg(int reg, int val)
 	}
 }
 
+// Switches emulators when rendering a buffer takes too much or too little of its play time.
+static void ScaleQuality(std::chrono::steady_clock::duration renderTime)
+{
+	if (!qualityScaler.isEnabled() || !currentSong)
+	{
+		return;
+	}
+	float load = std::chrono::duration<float>(renderTime).count() * SOUND_SAMPLE_RATE / SOUND_BUFFER_LENGTH;
+	int type = qualityScaler.update(emulatorPool.getType(opl->getEmulator()), load);
+	if (type && !SwitchEmulator(type) && qualityScaler.markUnavailable(type))
+	{
+		Log("Emulator %d could not be created.  Quality scaling will skip it.", type);
+	}
+}
+
+// When the gain boosts the music, output above this fraction of full scale is softly compressed instead of clipped.
+#define GAIN_LIMIT_KNEE	0.8f
+
+// Scales rendered samples by musicGain.  Only boosting can pass full scale, so only then are the samples limited.
+static void ApplyGain(short *samples, int count)
+{
+	const float range = 1.0f - GAIN_LIMIT_KNEE;
+	for (int index = 0; index < count; index++)
+	{
+		float value = samples[index] / 32768.0f * musicGain;
+		float magnitude = fabsf(value);
+		if (musicGain > 1.0f && magnitude > GAIN_LIMIT_KNEE)
+		{
+			// Approaches full scale without reaching it, with the same slope as the linear part at the knee.
+			magnitude = GAIN_LIMIT_KNEE + range * tanhf((magnitude - GAIN_LIMIT_KNEE) / range);
+			value = value < 0 ? -magnitude : magnitude;
+		}
+		samples[index] = (short)std::max(-32768L, std::min(32767L, lrintf(value * 32768.0f)));
+	}
+}
+
 void LoadNextBuffer()
 {
 	Log("%d - LoadNextBuffer: %d", agk::GetMilliseconds(), nextBuffer);
@@ -224,6 +366,7 @@ void LoadNextBuffer()
 		int index = 0;
 		int frames;
 		bool eof = false;
+		auto renderStart = std::chrono::steady_clock::now();
 		do {
 			if (!framesToRender)
 			{
@@ -273,6 +416,12 @@ void LoadNextBuffer()
 				}
 			}
 		} while (index < SOUND_BUFFER_LENGTH);
+		ScaleQuality(std::chrono::steady_clock::now() - renderStart);
+		// At a gain of 1, the emulator's output is left exactly as it is.
+		if (musicGain != 1.0f)
+		{
+			ApplyGain(reinterpret_cast<short *>(bufferPos[nextBuffer]), index * SOUND_CHANNELS);
+		}
 	}
 	// Recreate the music sound object.
 	agk::CreateSoundFromMemblock(musicSoundID, musicMemblockID);
@@ -330,18 +479,69 @@ void Shutdown()
 		agk::DeleteMemblock(musicMemblockID);
 		musicMemblockID = 0;
 	}
+	musicLibrary.cancelScan();
 	DeleteAllExternalData();
 	DeleteAllMusic();
+	for (size_t index = 0; index < archives.size(); index++)
+	{
+		if (archives[index])
+		{
+			CloseMusicArchive((int)index + 1);
+		}
+	}
+	archives.clear();
 	if (opl)
 	{
+		emulatorPool.release(opl->getEmulator());
 		delete opl;
 		opl = NULL;
 	}
+	emulatorPool.clear();
+}
+
+void CloseMusicArchive(int archiveID)
+{
+	std::lock_guard<std::recursive_mutex> guard(providerLock);
+	if (archiveID <= 0 || (size_t)archiveID > archives.size() || !archives[archiveID - 1])
+	{
+		agk::PluginError("Invalid music archive ID.");
+		return;
+	}
+	diskFileProvider.remove(archives[archiveID - 1]);
+	// Cached data might have come from the archive.
+	bankCache.clear();
+	delete archives[archiveID - 1];
+	archives[archiveID - 1] = NULL;
+}
+
+int CreateMusicArchive(const char *folder, const char *filename, int compress)
+{
+	std::string folderPath = GetReadableFolderPath(folder);
+	if (folderPath.empty())
+	{
+		std::string msg = "Could not find folder '";
+		msg.append(folder);
+		msg.append("'");
+		agk::PluginError(msg.c_str());
+		return 0;
+	}
+	if (!CreateArchive(folderPath, GetWritableFilePath(filename), compress != 0))
+	{
+		std::string msg = "Could not create music archive '";
+		msg.append(filename);
+		msg.append("'");
+		agk::PluginError(msg.c_str());
+		return 0;
+	}
+	return 1;
 }
 
 void DeleteAllExternalData()
 {
-	fileProvider.clear();
+	std::lock_guard<std::recursive_mutex> guard(providerLock);
+	bankCache.clear();
+	mappedFileProvider.clear();
+	memblockFileProvider.clear();
 }
 
 void DeleteAllMusic()
@@ -355,7 +555,10 @@ void DeleteAllMusic()
 
 void DeleteExternalData(const char *entryname)
 {
-	fileProvider.removeFile(entryname);
+	std::lock_guard<std::recursive_mutex> guard(providerLock);
+	bankCache.removeFile(entryname);
+	mappedFileProvider.removeFile(entryname);
+	memblockFileProvider.removeFile(entryname);
 }
 
 void DeleteMusic(int songID)
@@ -370,6 +573,21 @@ void DeleteMusic(int songID)
 	songs[songID] = NULL;
 }
 
+int ExportMusicStream(int songID, const char *filename)
+{
+	ValidateSongPlayer(songID, 0);
+	std::lock_guard<std::recursive_mutex> guard(providerLock);
+	if (!songs[songID]->GetData()->exportStream(songs[songID]->GetLengthSubsong(), GetWritableFilePath(filename)))
+	{
+		std::string msg = "Could not export music stream '";
+		msg.append(filename);
+		msg.append("'");
+		agk::PluginError(msg.c_str());
+		return 0;
+	}
+	return 1;
+}
+
 static char *CreateString(std::string text)
 {
 	unsigned int size = text.size() + 1;
@@ -378,34 +596,196 @@ static char *CreateString(std::string text)
 	return str;
 }
 
+// Memblock layout: found, subsong count, then the format, title, author, and description as length-prefixed strings.
+static unsigned int CreateMusicInfoMemblock(bool found, const MusicInfo &info)
+{
+	const std::string *strings[] = { &info.format, &info.title, &info.author, &info.description };
+	unsigned int size = 8;
+	for (const std::string *text : strings)
+	{
+		size += 4 + (unsigned int)text->size();
+	}
+	unsigned int memblockID = agk::CreateMemblock(size);
+	agk::SetMemblockInt(memblockID, 0, found ? 1 : 0);
+	agk::SetMemblockInt(memblockID, 4, info.subsongs);
+	unsigned int offset = 8;
+	for (const std::string *text : strings)
+	{
+		agk::SetMemblockInt(memblockID, offset, (int)text->size());
+		agk::SetMemblockString(memblockID, offset + 4, text->c_str());
+		offset += 4 + (unsigned int)text->size();
+	}
+	return memblockID;
+}
+
+// Song IDs can share their data, so each is only counted once.
+static std::set<SongData *> GetAllSongData()
+{
+	std::set<SongData *> all;
+	for (AgkPlayer *song : songs)
+	{
+		if (song)
+		{
+			all.insert(song->GetData().get());
+		}
+	}
+	return all;
+}
+
+static unsigned long long GetTotalMusicMemoryUsage()
+{
+	unsigned long long usage = 0;
+	for (SongData *data : GetAllSongData())
+	{
+		usage += data->getSourceSize() + data->getDecodedSize();
+	}
+	return usage;
+}
+
+// Evicts the least recently used songs until the memory usage fits the budget.  The playing song and the last song used are kept.
+static void EnforceMusicMemoryBudget()
+{
+	if (!musicMemoryBudget)
+	{
+		return;
+	}
+	std::set<SongData *> all = GetAllSongData();
+	unsigned long long usage = GetTotalMusicMemoryUsage();
+	while (usage > musicMemoryBudget)
+	{
+		SongData *oldest = NULL;
+		for (SongData *data : all)
+		{
+			if ((!currentSong || data != currentSong->GetData().get()) && data->isDecoded() && data->getLastUse() != musicUseCount
+				&& (!oldest || data->getLastUse() < oldest->getLastUse()))
+			{
+				oldest = data;
+			}
+		}
+		if (!oldest)
+		{
+			break;
+		}
+		Log("Evicting decoded music %s.", oldest->getFilename().c_str());
+		usage -= oldest->getDecodedSize();
+		oldest->evict();
+	}
+}
+
+int GetAllMusicMemoryUsage()
+{
+	return (int)GetTotalMusicMemoryUsage();
+}
+
+int GetExternalDataMemoryUsage()
+{
+	std::lock_guard<std::recursive_mutex> guard(providerLock);
+	return (int)bankCache.getMemoryUsage();
+}
+
 char *GetMusicAuthor(int songID)
 {
-	ValidateSongID(songID, NULL);
+	ValidateSongPlayer(songID, NULL);
 	return CreateString(songs[songID]->GetAuthor());
 }
 
+int GetMusicDecoded(int songID)
+{
+	ValidateSongID(songID, 0);
+	return songs[songID]->GetData()->isDecoded();
+}
+
 char *GetMusicDescription(int songID)
 {
-	ValidateSongID(songID, NULL);
+	ValidateSongPlayer(songID, NULL);
 	return CreateString(songs[songID]->GetDescription());
 }
 
+int GetMusicDroppedWrites()
+{
+	return opl ? (int)opl->getDroppedWrites() : 0;
+}
+
 float GetMusicDuration(int songID)
 {
-	ValidateSongID(songID, 0.0f);
+	ValidateSongPlayer(songID, 0.0f);
+	// The library index already measured the song.
+	LibraryEntry entry;
+	unsigned int subsong = songs[songID]->GetLengthSubsong();
+	if (musicLibrary.findEntry(songs[songID]->GetKey(), entry) && subsong < entry.durations.size())
+	{
+		return entry.durations[subsong] / 1000.0f;
+	}
 	return songs[songID]->GetSongLength();
 }
 
+int GetMusicEmulator()
+{
+	return opl ? emulatorPool.getType(opl->getEmulator()) : 0;
+}
+
 int GetMusicExists(int songID)
 {
 	return (songID > 0 && (size_t)songID <= songs.size() && songs[songID - 1]);
 }
 
+// Note that the library index is 0-based.
+#define ValidateLibraryIndex(index, entry, returnValue)	\
+	LibraryEntry entry;									\
+	if (!musicLibrary.getEntry(index, entry))			\
+	{													\
+		agk::PluginError("Invalid music library index.");	\
+		return returnValue;								\
+	}
+
+int GetMusicLibraryCount()
+{
+	return (int)musicLibrary.size();
+}
+
+float GetMusicLibraryDuration(int index, int subsong)
+{
+	ValidateLibraryIndex(index, entry, 0.0f);
+	if (subsong < 0 || (size_t)subsong >= entry.durations.size())
+	{
+		return 0.0f;
+	}
+	return entry.durations[subsong] / 1000.0f;
+}
+
+char *GetMusicLibraryFile(int index)
+{
+	ValidateLibraryIndex(index, entry, NULL);
+	return CreateString(entry.filename);
+}
+
+int GetMusicLibraryInfo(int index)
+{
+	ValidateLibraryIndex(index, entry, 0);
+	return (int)CreateMusicInfoMemblock(true, entry.info);
+}
+
+float GetMusicLibraryScanProgress()
+{
+	return musicLibrary.getScanProgress();
+}
+
+char *GetMusicLoadProbes()
+{
+	return CreateString(lastLoadProbes);
+}
+
 int GetMusicLoopCount()
 {
 	return loopCount;
 }
 
+int GetMusicMemoryUsage(int songID)
+{
+	ValidateSongID(songID, 0);
+	return (int)(songs[songID]->GetData()->getSourceSize() + songs[songID]->GetData()->getDecodedSize());
+}
+
 int GetMusicPaused()
 {
 	return musicPaused;
@@ -429,7 +809,7 @@ float GetMusicPosition(int songID)
 
 int GetMusicRate(int songID)
 {
-	ValidateSongID(songID, 0);
+	ValidateSongPlayer(songID, 0);
 	return songs[songID]->GetSpeed();
 }
 
@@ -446,7 +826,7 @@ int GetMusicSubsong(int songID)
 
 int GetMusicSubsongCount(int songID)
 {
-	ValidateSongID(songID, 0);
+	ValidateSongPlayer(songID, 0);
 	return songs[songID]->GetSubsongCount();
 }
 
@@ -457,13 +837,13 @@ int GetMusicSystemVolume()
 
 char *GetMusicTitle(int songID)
 {
-	ValidateSongID(songID, NULL);
+	ValidateSongPlayer(songID, NULL);
 	return CreateString(songs[songID]->GetTitle());
 }
 
 char *GetMusicType(int songID)
 {
-	ValidateSongID(songID, NULL);
+	ValidateSongPlayer(songID, NULL);
 	return CreateString(songs[songID]->GetType());
 }
 
@@ -473,6 +853,19 @@ int GetMusicVolume(int songID)
 	return songs[songID]->GetVolume();
 }
 
+static bool ExternalDataExists(const char *entryname)
+{
+	return mappedFileProvider.hasFile(entryname) || memblockFileProvider.hasFile(entryname);
+}
+
+static void ReportExternalDataExists(const char *entryname)
+{
+	std::string msg = "An external data entry already exists for '";
+	msg.append(entryname);
+	msg.append("'");
+	agk::PluginError(msg.c_str());
+}
+
 void LoadExternalDataFromFile(const char *filename)
 {
 	LoadExternalDataFromFileEx(filename, filename);
@@ -480,6 +873,18 @@ void LoadExternalDataFromFile(const char *filename)
 
 void LoadExternalDataFromFileEx(const char *filename, const char *entryname)
 {
+	std::lock_guard<std::recursive_mutex> guard(providerLock);
+	if (ExternalDataExists(entryname))
+	{
+		ReportExternalDataExists(entryname);
+		return;
+	}
+	// Map the file from disk when possible.  It won't be read until a song needs it.
+	std::string path = GetReadableFilePath(filename);
+	if (path.size() && mappedFileProvider.addFile(entryname, path))
+	{
+		return;
+	}
 	unsigned int memblockID = agk::CreateMemblockFromFile(filename);
 	LoadExternalDataFromMemblock(memblockID, entryname);
 	agk::DeleteMemblock(memblockID);
@@ -487,19 +892,92 @@ void LoadExternalDataFromFileEx(const char *filename, const char *entryname)
 
 void LoadExternalDataFromMemblock(int memblockID, const char *entryname)
 {
+	std::lock_guard<std::recursive_mutex> guard(providerLock);
+	if (ExternalDataExists(entryname))
+	{
+		ReportExternalDataExists(entryname);
+		return;
+	}
 	unsigned int size = agk::GetMemblockSize(memblockID);
 	unsigned int memID = agk::CreateMemblock(size);
 	agk::CopyMemblock(memblockID, memID, 0, 0, size);
-	if (!fileProvider.addFile(entryname, memID))
+	memblockFileProvider.addFile(entryname, memID);
+}
+
+static void ReportLoadMusicError(const char *filename, std::string error)
+{
+	std::string msg = "Error loading music: ";
+	msg.append(filename);
+	msg.append("\n");
+	msg.append(error);
+	agk::PluginError(msg.c_str());
+}
+
+// The plugin's players come before AdPlug's so that they are tried first for the extensions they share.
+static const CPlayers &GetPlayers()
+{
+	static const CPlayers players = []() {
+		CPlayers list;
+		list.push_back(&VgmStreamPlayer::desc);
+		list.push_back(&RegisterDumpPlayer::desc);
+		list.insert(list.end(), CAdPlug::players.begin(), CAdPlug::players.end());
+		return list;
+	}();
+	return players;
+}
+
+// CAdPlug::players is initialized by AdPlug, so the detector can't be built until it is used.
+static FormatDetector &GetFormatDetector()
+{
+	static FormatDetector formatDetector(GetPlayers());
+	return formatDetector;
+}
+
+// Creates the song's player if it hasn't been already.  Reports an error if no player loads the song.
+static bool DecodeMusic(AgkPlayer *song)
+{
+	SongData *data = song->GetData().get();
+	data->setLastUse(++musicUseCount);
+	if (data->isDecoded())
 	{
-		std::string msg = "An external data entry already exists for '";
-		msg.append(entryname);
-		msg.append("'");
-		agk::PluginError(msg.c_str());
+		return true;
+	}
+	bool decoded = data->decode();
+	lastLoadProbes = data->getLoadProbes();
+	if (!decoded)
+	{
+		ReportLoadMusicError(data->getFilename().c_str(), data->getLoadError());
+		return false;
+	}
+	// Songs loaded from the stream cache didn't run a player.
+	if (data->getLoadedBy())
+	{
+		GetFormatDetector().remember(data->getKey(), data->getLoadedBy());
 	}
+	EnforceMusicMemoryBudget();
+	return true;
 }
 
-int LoadMusic(const char *filename, unsigned int memblockID)
+// Returns the data of a loaded song with the same content, or NULL.
+static std::shared_ptr<SongData> FindSongData(const CAdPlugDatabase::CKey &key, const SongSource &source)
+{
+	for (AgkPlayer *song : songs)
+	{
+		if (song && song->GetData()->hasSameContent(key, source))
+		{
+			return song->GetData();
+		}
+	}
+	return NULL;
+}
+
+/*
+Loads a song that has been added to one of the file providers under the given file name.
+Files mapped from disk are mapped again when the song is decoded.  Other files are copied, as are all files when compressing.
+Only the players that are likely to load the file are tried before the rest.
+Songs with the same content as a loaded song share its data.
+*/
+int LoadMusic(const char *filename)
 {
 	if (!opl)
 	{
@@ -507,59 +985,127 @@ int LoadMusic(const char *filename, unsigned int memblockID)
 		return 0;
 	}
 	Log("Loading music from %s", filename);
-	CPlayer	*p = NULL;
-	std::string error;
-	//agk::Message(filename);
-	if (fileProvider.addFile(filename, memblockID))
+	std::lock_guard<std::recursive_mutex> guard(providerLock);
+	lastLoadProbes.clear();
+	SongSource *source = NULL;
+	// The song isn't a bank, so keep it out of the bank cache.
+	bankCache.setSongFile(filename);
+	binistream *f = fileProvider.open(filename);
+	if (f)
 	{
-		try
-		{
-			p = CAdPlug::factory(filename, opl, CAdPlug::players, fileProvider);
-		}
-		catch (int e)
-		{
-			error.append("Error #").append(std::to_string(e));
-		}
-		catch (std::string e)
-		{
-			error.append(e);
-		}
-		catch (...)
+		source = new SongSource(filename, fileProvider, providerLock);
+		// Memblocks are gone once the load returns, so only files on disk can be read again later.
+		std::string path = memblockFileProvider.hasFile(filename) ? "" : mappedFileProvider.getPath(filename);
+		if (compressMusicSources || path.empty() || !source->map(path))
 		{
-			error.append("Unknown error.");
+			source->read(f, compressMusicSources);
 		}
-		fileProvider.removeFile(filename);
+		fileProvider.close(f);
 	}
-	else
+	bankCache.setSongFile("");
+	if (!source)
 	{
-		error.append("A data entry already exists for this file name.");
+		ReportLoadMusicError(filename, "Failed to determine music file type.");
+		return 0;
 	}
-	if (!p && error.size() == 0)
+	CAdPlugDatabase::CKey key;
+	f = source->open(filename);
+	std::vector<const CPlayerDesc *> candidates = GetFormatDetector().getCandidates(filename, f, key);
+	source->close(f);
+	std::shared_ptr<SongData> data = FindSongData(key, *source);
+	if (data)
 	{
-		error.append("Failed to determine music file type.");
+		Log("Sharing data with an identical song loaded from %s.", data->getFilename().c_str());
+		delete source;
 	}
-	if (error.size() > 0)
+	else
 	{
-		delete p;
-		std::string msg = "Error loading music: ";
-		msg.append(filename);
-		msg.append("\n");
-		msg.append(error);
-		agk::PluginError(msg.c_str());
+		data = std::make_shared<SongData>(source, candidates, key, opl, providerLock);
+		data->setPrecompile(precompileMusic);
+		data->setStreamCache(musicStreamCache);
+	}
+	AgkPlayer *song = new AgkPlayer(data, SOUND_SAMPLE_RATE, SOUND_CHANNELS);
+	if (!deferMusicLoading && !DecodeMusic(song))
+	{
+		delete song;
 		return 0;
 	}
-	//Log("file: '%s' loaded = %d", filename, p);
-	//p->rewind(3);
-	songs.push_back(new AgkPlayer(p));
+	songs.push_back(song);
 	Log("Loaded music %d from file %s.", (int)songs.size(), filename);
 	return (int)songs.size();
 }
 
+// Adds the song data to the memblock file provider while it loads.
+int LoadMusic(const char *filename, unsigned int memblockID)
+{
+	std::lock_guard<std::recursive_mutex> guard(providerLock);
+	if (!memblockFileProvider.addFile(filename, memblockID))
+	{
+		ReportLoadMusicError(filename, "A data entry already exists for this file name.");
+		return 0;
+	}
+	int songID = LoadMusic(filename);
+	memblockFileProvider.removeFile(filename);
+	return songID;
+}
+
+/*
+Makes a song file readable through the file providers under its own name.
+Archives serve the file directly.  Otherwise the file is mapped from disk or, failing that, read into a memblock.
+memblockID is set to the memblock that RemoveMusicFile must delete, or 0.
+*/
+static bool AddMusicFile(const char *filename, unsigned int &memblockID)
+{
+	memblockID = 0;
+	if (ExternalDataExists(filename))
+	{
+		ReportLoadMusicError(filename, "A data entry already exists for this file name.");
+		return false;
+	}
+	for (ArchiveFileProvider *archive : archives)
+	{
+		if (archive && archive->hasFile(filename))
+		{
+			return true;
+		}
+	}
+	// The players read from the mapping without an intermediate copy.
+	std::string path = GetReadableFilePath(filename);
+	if (path.size() && mappedFileProvider.addFile(filename, path))
+	{
+		return true;
+	}
+	memblockID = agk::CreateMemblockFromFile(filename);
+	if (!memblockFileProvider.addFile(filename, memblockID))
+	{
+		agk::DeleteMemblock(memblockID);
+		memblockID = 0;
+		ReportLoadMusicError(filename, "A data entry already exists for this file name.");
+		return false;
+	}
+	return true;
+}
+
+static void RemoveMusicFile(const char *filename, unsigned int memblockID)
+{
+	mappedFileProvider.removeFile(filename);
+	if (memblockID)
+	{
+		memblockFileProvider.removeFile(filename);
+		agk::DeleteMemblock(memblockID);
+	}
+}
+
 int LoadMusicFromFile(const char *filename)
 {
-	unsigned int memblockID = agk::CreateMemblockFromFile(filename);
-	int songID = LoadMusic(filename, memblockID);
-	agk::DeleteMemblock(memblockID);
+	std::lock_guard<std::recursive_mutex> guard(providerLock);
+	unsigned int memblockID;
+	if (!AddMusicFile(filename, memblockID))
+	{
+		return 0;
+	}
+	int songID = LoadMusic(filename);
+	RemoveMusicFile(filename, memblockID);
 	return songID;
 }
 
@@ -570,6 +1116,40 @@ int LoadMusicFromMemblock(int memblockID, const char *filetype)
 	return LoadMusic(filename, memblockID);
 }
 
+int LoadMusicLibrary(const char *filename)
+{
+	std::string path = GetReadableFilePath(filename);
+	if (path.empty() || !musicLibrary.load(path))
+	{
+		std::string msg = "Could not load music library '";
+		msg.append(filename);
+		msg.append("'");
+		agk::PluginError(msg.c_str());
+		return 0;
+	}
+	return 1;
+}
+
+int OpenMusicArchive(const char *filename)
+{
+	std::lock_guard<std::recursive_mutex> guard(providerLock);
+	std::string path = GetReadableFilePath(filename);
+	ArchiveFileProvider *archive = new ArchiveFileProvider();
+	if (path.empty() || !archive->load(path))
+	{
+		delete archive;
+		std::string msg = "Could not open music archive '";
+		msg.append(filename);
+		msg.append("'");
+		agk::PluginError(msg.c_str());
+		return 0;
+	}
+	diskFileProvider.add(archive);
+	archives.push_back(archive);
+	Log("Opened music archive %d from file %s.", (int)archives.size(), filename);
+	return (int)archives.size();
+}
+
 void PauseMusic()
 {
 	if (musicPaused)
@@ -594,8 +1174,9 @@ void PlayMusic(int songID, int loop)
 	StopMusic();
 	ResetOPL();
 	Log("PlayMusic: %d. loop = %d", songID, loop);
-	ValidateSongID(songID, );
+	ValidateSongPlayer(songID, );
 	currentSong = songs[songID];
+	SelectEmulator(currentSong);
 	// Rewind takes the song to the current seek position, which might be 0 anyway.
 	currentSong->Rewind();
 	//Log("framesPerTic: %d", framesPerTic);
@@ -614,7 +1195,7 @@ void PlayMusic(int songID, int loop)
 void PlaySound(int songID, int subsong)
 {
 	Log("PlaySound: %d / %d", songID, subsong);
-	ValidateSongID(songID, );
+	ValidateSongPlayer(songID, );
 	// If not currently playing the given song, switch to it.
 	if (currentSong == songs[songID])
 	{
@@ -629,6 +1210,35 @@ void PlaySound(int songID, int subsong)
 	}
 }
 
+void PrefetchMusic(int songID)
+{
+	ValidateSongID(songID, );
+	songs[songID]->GetData()->prefetch(backgroundWorker);
+}
+
+int ProbeMusicInfo(const char *filename)
+{
+	std::lock_guard<std::recursive_mutex> guard(providerLock);
+	unsigned int memblockID;
+	if (!AddMusicFile(filename, memblockID))
+	{
+		return 0;
+	}
+	MusicInfo info;
+	bool found = false;
+	// The file isn't a bank, so keep it out of the bank cache.
+	bankCache.setSongFile(filename);
+	binistream *f = fileProvider.open(filename);
+	if (f)
+	{
+		found = ProbeMusicHeader(f, GetFormatDetector().getLikelyPlayers(filename, f), info);
+		fileProvider.close(f);
+	}
+	bankCache.setSongFile("");
+	RemoveMusicFile(filename, memblockID);
+	return (int)CreateMusicInfoMemblock(found, info);
+}
+
 void ResumeMusic()
 {
 	if (!musicPaused)
@@ -647,9 +1257,40 @@ void ResumeMusic()
 	lastClockLoopCount = agk::GetSoundInstanceLoopCount(clockSoundInstance);
 }
 
+int ScanMusicLibrary(const char *folder, const char *indexFilename)
+{
+	if (musicLibrary.isScanning())
+	{
+		agk::PluginError("A music library scan is already running.");
+		return 0;
+	}
+	std::string folderPath = GetReadableFolderPath(folder);
+	if (folderPath.empty())
+	{
+		std::string msg = "Could not find folder '";
+		msg.append(folder);
+		msg.append("'");
+		agk::PluginError(msg.c_str());
+		return 0;
+	}
+	// Keep the songs that are already indexed so they aren't measured again.
+	std::string indexPath = GetReadableFilePath(indexFilename);
+	if (indexPath.size())
+	{
+		musicLibrary.load(indexPath);
+	}
+	std::string prefix = folder;
+	if (prefix.size() && prefix.back() != '/' && prefix.back() != '\\')
+	{
+		prefix.append("/");
+	}
+	musicLibrary.startScan(folderPath, prefix, GetWritableFilePath(indexFilename), GetFormatDetector(), backgroundWorker, providerLock);
+	return 1;
+}
+
 void SeekMusic(int songID, float seconds, int mode)
 {
-	ValidateSongID(songID, );
+	ValidateSongPlayer(songID, );
 	songs[songID]->Seek(seconds, mode);
 	if (currentSong == songs[songID])
 	{
@@ -657,15 +1298,62 @@ void SeekMusic(int songID, float seconds, int mode)
 	}
 }
 
+void SetMusicCompression(int compress)
+{
+	compressMusicSources = (compress != 0);
+}
+
+void SetMusicDeferredLoading(int deferred)
+{
+	deferMusicLoading = (deferred != 0);
+}
+
+void SetMusicGain(int percent)
+{
+	musicGain = limit(percent, 0, 400) / 100.0f;
+}
+
 void SetMusicLoopCount(int loop)
 {
 	currentLoopSetting = loop;
 	loopCount = 0;
 }
 
+void SetMusicMemoryBudget(int bytes)
+{
+	musicMemoryBudget = bytes > 0 ? (unsigned long)bytes : 0;
+	EnforceMusicMemoryBudget();
+}
+
+void SetMusicPrecompile(int mode)
+{
+	precompileMusic = (PrecompileMode)limit(mode, PRECOMPILE_NONE, PRECOMPILE_AUTO);
+}
+
+void SetMusicQualityScaling(int enabled)
+{
+	qualityScaler.setEnabled(enabled != 0);
+}
+
+void SetMusicStreamCache(const char *folder)
+{
+	std::string path = folder;
+	if (path.empty())
+	{
+		musicStreamCache.clear();
+		return;
+	}
+	if (path.back() != '/' && path.back() != '\\')
+	{
+		path.append("/");
+	}
+	// Creates the folder.
+	musicStreamCache = GetWritableFilePath(path);
+}
+
 void SetMusicSubsong(int songID, int subsong)
 {
-	ValidateSongID(songID, );
+	ValidateSongPlayer(songID, );
 	//unsigned int oldSubsong = songs[songID]->getsubsong();
 	songs[songID]->SetSubsong(subsong);
 	// If currently playing, immediately start playing the new subsong.
@@ -699,13 +1387,22 @@ void SetMusicVolume(int songID, int volume)
 	}
 }
 
+void SetMusicWriteFilter(int enabled)
+{
+	filterRegisterWrites = (enabled != 0);
+	if (opl)
+	{
+		opl->setEnabled(filterRegisterWrites);
+	}
+}
+
 void StopMusic()
 {
 	agk::Log("Stopping music.");
 	if (currentSong)
 	{
-		// Rewind the wong and clear this pointer, but do not delete the song!
-		currentSong->Rewind();
+		// Rewind the song and clear this pointer, but do not delete the song!  Nothing will be heard, so don't settle.
+		currentSong->Rewind(false);
 		currentSong = NULL;
 	}
 	if (soundInstance)
@@ -34,6 +34,7 @@ Emulator Types
 #define OPL_SILVERMAN	3
 #define OPL_SATOH		4
 #define OPL_DUAL		5
+#define OPL_AUTO		6
 
 //#define SEEK_ABSOLUTE	0
 //#define SEEK_RELATIVE	1
@@ -49,7 +50,10 @@ All emulators play as 16-bit stereo 44100 Hz sounds.
 2 = DOSBox emulator.  
 3 = Ken Silverman's emulator.  
 4 = Tatsuyuki Satoh's emulator.  
-5 = Dual OPL.
+5 = Dual OPL.  
+6 = Automatic.  Each song plays on the cheapest emulator that supports its chip: DOSBox for OPL2 songs, Dual OPL for dual OPL2 songs,
+and Nuked for OPL3 songs.  Register captures, VGM files, and compiled songs list their chip.  Other songs are checked by playing
+their first few seconds while they load, so a song that only turns to OPL3 or the second chip later plays on a lesser emulator.
 @return 1 on success; otherwise 0.
 */
 extern "C" DLL_EXPORT int Init(int emulator);
@@ -63,6 +67,21 @@ This is done when the plugin unloads and does not need to be explicitly called.
 */
 extern "C" DLL_EXPORT void Shutdown();
 /*
+@desc Closes a music archive.
+Songs that were already loaded from the archive continue to work.
+@param archiveID The archive ID to close.
+*/
+extern "C" DLL_EXPORT void CloseMusicArchive(int archiveID);
+/*
+@desc Packs every file in a folder and its subfolders into a single music archive.
+Entry names are the file paths relative to the folder, using forward slashes.
+@param folder	The folder to pack.
+@param filename	The archive file to create.
+@param compress	1 to compress entries that get smaller when compressed; otherwise 0.
+@return 1 on success; otherwise 0.
+*/
+extern "C" DLL_EXPORT int CreateMusicArchive(const char *folder, const char *filename, int compress);
+/*
 @desc Deletes all external data entries.
 */
 extern "C" DLL_EXPORT void DeleteAllExternalData();
@@ -81,35 +100,119 @@ extern "C" DLL_EXPORT void DeleteExternalData(const char *entryname);
 */
 extern "C" DLL_EXPORT void DeleteMusic(int songID);
 /*
+@desc Plays a song through once and saves its register writes and timing as an ADS stream file.
+ADS files load with LoadMusicFromFile like any other song.  They play without running the original player's
+sequencing, load quickly, and seek instantly.
+@param songID	The music ID.
+@param filename	The file to create.
+@return 1 on success; otherwise 0.  Songs that don't end within ten minutes can't be exported.
+*/
+extern "C" DLL_EXPORT int ExportMusicStream(int songID, const char *filename);
+/*
+@desc Returns the memory used by all loaded songs.  See GetMusicMemoryUsage.
+@return The number of bytes.
+*/
+extern "C" DLL_EXPORT int GetAllMusicMemoryUsage();
+/*
+@desc Returns the number of bytes of external data that songs have read from files and archives.
+This data is read once and shared by every song that uses it.  Files with identical content are only stored once.
+@return The size in bytes.
+*/
+extern "C" DLL_EXPORT int GetExternalDataMemoryUsage();
+/*
 @desc Returns a song's author.
 @param songID The ID of the song.
 @return A string.
 */
 extern "C" DLL_EXPORT char *GetMusicAuthor(int songID);
 /*
+@desc Returns whether a song is currently decoded.
+Songs aren't decoded yet when SetMusicDeferredLoading is used, and songs can be evicted by SetMusicMemoryBudget.
+@param songID The song ID.
+@return 1 if decoded; otherwise 0.
+*/
+extern "C" DLL_EXPORT int GetMusicDecoded(int songID);
+/*
 @desc Returns the song's description.
 @param songID The ID of the song.
 @return A string.
 */
 extern "C" DLL_EXPORT char *GetMusicDescription(int songID);
 /*
+@desc Returns the number of register writes that the write filter has dropped since the emulator was initialized.
+See SetMusicWriteFilter.
+@return The number of writes.
+*/
+extern "C" DLL_EXPORT int GetMusicDroppedWrites();
+/*
 @desc Returns the duration of the song in seconds.
 This should not be called on a song while it is playing or the song will start again from the beginning.
+If the song is in the music library, the duration comes from the library and the song is not affected.
 @param songID The song ID.
 @return Duration in seconds.
 */
 extern "C" DLL_EXPORT float GetMusicDuration(int songID);
 /*
+@desc Returns the emulator that music is playing on.  With automatic selection, this changes as songs start playing.
+@return The type of the emulator in use, as numbered for Init, or 0 if the plugin isn't initialized.
+*/
+extern "C" DLL_EXPORT int GetMusicEmulator();
+/*
 @desc Checks the existence for the given song ID.
 @return 1 if a song exists at the specified ID; otherwise 0.
 */
 extern "C" DLL_EXPORT int GetMusicExists(int songID);
 /*
+@desc Returns the number of songs in the music library.
+@return The song count.
+*/
+extern "C" DLL_EXPORT int GetMusicLibraryCount();
+/*
+@desc Returns the duration of a subsong of a song in the music library.
+@param index	The library index, from 0 to GetMusicLibraryCount() - 1.
+@param subsong	The subsong.
+@return Duration in seconds, or 0 if the subsong doesn't exist.
+*/
+extern "C" DLL_EXPORT float GetMusicLibraryDuration(int index, int subsong);
+/*
+@desc Returns the file name of a song in the music library, which can be given to LoadMusicFromFile.
+@param index The library index, from 0 to GetMusicLibraryCount() - 1.
+@return The file name.
+*/
+extern "C" DLL_EXPORT char *GetMusicLibraryFile(int index);
+/*
+@desc Returns the format, title, author, description, and subsong count of a song in the music library
+in a new memblock with the same layout as ProbeMusicInfo.  Delete the memblock when done with it.
+@param index The library index, from 0 to GetMusicLibraryCount() - 1.
+@return The memblock ID.
+*/
+extern "C" DLL_EXPORT int GetMusicLibraryInfo(int index);
+/*
+@desc Returns the progress of the music library scan started by ScanMusicLibrary.
+@return From 0 to 1.  1 when no scan is running.
+*/
+extern "C" DLL_EXPORT float GetMusicLibraryScanProgress();
+/*
+@desc Returns the file types of the players that the last music load tried, in the order they were tried.
+The plugin tries the player that loaded the same content before, then players that recognize the file header,
+then players for the file extension, and finally every other player.
+@return A comma-separated list of file types.  The last one loaded the song if the load succeeded.
+*/
+extern "C" DLL_EXPORT char *GetMusicLoadProbes();
+/*
 @desc Returns the number of times the current song has looped.
 @return The loop count.
 */
 extern "C" DLL_EXPORT int GetMusicLoopCount();
 /*
+@desc Returns the memory used by a song: the copy of its file plus, when decoded, an estimate of what its player allocated while loading.
+The estimate is how much the heap grew during the load, so memory allocated by other threads at the same time is included.
+Song IDs loaded from identical files share this memory.
+@param songID The song ID.
+@return The number of bytes.
+*/
+extern "C" DLL_EXPORT int GetMusicMemoryUsage(int songID);
+/*
 @desc Returns whether music playback is paused.
 @return 1 if paused; otherwise 0.
 */
@@ -177,6 +280,8 @@ extern "C" DLL_EXPORT int GetMusicVolume(int songID);
 @desc Load external data required for some music file formats from a file.
 Will raise an error if an entry with this name already exists.
 
+Files on disk are memory-mapped and are only read when a song needs them.
+
 ie: The standard.bnk for ROL files.
 @param filename	The file to load.  This is used as the entry name internally.
 */
@@ -206,6 +311,9 @@ ie: The standard.bnk for ROL files.
 extern "C" DLL_EXPORT void LoadExternalDataFromMemblock(int memblockID, const char *entryname);
 /*
 @desc Loads song information from the given file name.
+Open music archives are searched before the disk.
+Loading a file with the same content as a song that's already loaded shares that song's decoded data.
+The new song ID still has its own volume, subsong, and position.
 @param filename The name of the file to load.
 @return The music ID of the loaded song or 0 if an error occurs.
 */
@@ -214,10 +322,26 @@ extern "C" DLL_EXPORT int LoadMusicFromFile(const char *filename);
 @desc Loads song information from the given memblock.
 @param memblockID The memblock containing song information.
 @param filetype	The file extension without the leading period indicating the type of data in the memblock.
+Can be an empty string to detect the type from the data, which works for most formats that have a header.
 @return The music ID of the loaded song or 0 if an error occurs.
 */
 extern "C" DLL_EXPORT int LoadMusicFromMemblock(int memblockID, const char *filetype);
 /*
+@desc Loads a music library index saved by ScanMusicLibrary.
+Songs in the library answer GetMusicDuration without being played through.
+@param filename The index file.
+@return 1 if successful; otherwise 0.
+*/
+extern "C" DLL_EXPORT int LoadMusicLibrary(const char *filename);
+/*
+@desc Opens a music archive created by CreateMusicArchive.
+While the archive is open, LoadMusicFromFile loads songs from the archive when it contains the file name,
+and songs can find their external data (ie: standard.bnk) in the archive without loading it separately.
+@param filename The archive file to open.
+@return The archive ID or 0 if an error occurs.
+*/
+extern "C" DLL_EXPORT int OpenMusicArchive(const char *filename);
+/*
 @desc Pauses music playback.
 GetMusicPlaying will continue to return 1.
 */
@@ -240,10 +364,41 @@ The subsong will be played one time.
 */
 extern "C" DLL_EXPORT void PlaySound(int songID, int subsong);
 /*
+@desc Starts decoding a song on a background thread so that it's ready when it's played.
+Only useful with SetMusicDeferredLoading.  Call this when it's known which song will play next.
+Prefetched songs are decoded one at a time, in the order they were requested.
+@param songID The song ID.
+*/
+extern "C" DLL_EXPORT void PrefetchMusic(int songID);
+/*
+@desc Reads the format, title, author, description, and subsong count of a music file from its header
+without loading the song.  This is much faster than LoadMusicFromFile for listing many songs.
+The information is returned in a new memblock with this layout:
+  0: Integer.  1 if the file type was recognized; otherwise 0.
+  4: Integer.  The number of subsongs, or 0 if the header doesn't say.
+  8: The format, title, author, and description in that order.  Each is an integer length followed by that many bytes.
+The format is the name of the player's file type.  It can be less specific than GetMusicType,
+which is only known once the song is loaded.  Fields that the format doesn't store are empty.  Delete the memblock when done with it.
+@param filename The music file to probe.
+@return The memblock ID or 0 if an error occurs.
+*/
+extern "C" DLL_EXPORT int ProbeMusicInfo(const char *filename);
+/*
 @desc Resumes music playback if it was paused.
 */
 extern "C" DLL_EXPORT void ResumeMusic();
 /*
+@desc Starts scanning every music file in a folder and its subfolders into the music library.
+The songs are loaded and measured on a background thread, so this returns right away.  Use GetMusicLibraryScanProgress to check on it.
+The scan shares its thread with PrefetchMusic one file at a time, so a prefetch waits for at most one file to be scanned.
+Songs that are already in the index file aren't measured again.  Songs are identified by their content, not their file name.
+When the scan finishes, the library is saved to the index file so later sessions can use LoadMusicLibrary instead.
+@param folder			The folder to scan.
+@param indexFilename	The index file to update.
+@return 1 if the scan started; otherwise 0.
+*/
+extern "C" DLL_EXPORT int ScanMusicLibrary(const char *folder, const char *indexFilename);
+/*
 @desc Seeks to a given time value within the song.
 If the song is currently playing, it will continue playing from the new position.
 If the song is not currently playing, it will take effect after the next call to PlayMusic.
@@ -256,12 +411,78 @@ Changing subsongs resets the seek position to the beginning.
 */
 extern "C" DLL_EXPORT void SeekMusic(int songID, float seconds, int mode);
 /*
+@desc Sets whether songs loaded from now on keep their file data compressed in memory.
+Songs loaded from files on disk read the file again when they are decoded after SetMusicMemoryBudget evicts them.
+Other songs, and every song when compressing, keep a copy of the file instead.
+Compressed copies are unpacked a block at a time while decoding.  Register captures such as DRO, IMF, RAW, and VGM files compress well.
+Together with a memory budget, songs that aren't playing only take the space of their compressed file.
+@param compress 1 to compress; otherwise 0.  The default is 0.
+*/
+extern "C" DLL_EXPORT void SetMusicCompression(int compress);
+/*
+@desc Sets whether songs are decoded when they are loaded or when they are first used.
+When deferred, the load commands only keep the song file and detect its type.  The song is decoded the first time
+it's played or its information is requested, or in the background by PrefetchMusic.
+Errors in songs that can't be decoded are reported at that time instead of when loading.
+@param deferred 1 to defer decoding; 0 to decode when loading.  The default is 0.
+*/
+extern "C" DLL_EXPORT void SetMusicDeferredLoading(int deferred);
+/*
+@desc Sets the gain that the plugin applies to the music that the emulator renders, which is mainly for quiet songs.
+Unlike the volume, this can boost the music.  Above 100, peaks that would clip are softly limited instead.
+At 100, the emulator's output is passed through unchanged.
+It takes effect with the next sound buffer.
+@param percent The gain as a percentage, from 0 to 400.  The default is 100.
+*/
+extern "C" DLL_EXPORT void SetMusicGain(int percent);
+/*
 @desc Changes the number of times the current song will loop.
 This resets the loop count to 0.
 @param loop		The number of times to loop, or 1 to loop forever.
 */
 extern "C" DLL_EXPORT void SetMusicLoopCount(int loop);
 /*
+@desc Sets the most memory that the loaded songs should use.
+When decoding a song goes over the budget, the songs that have gone unused the longest are evicted.
+Evicted songs keep their IDs and settings and are decoded again when next used, or in the background by PrefetchMusic.
+The playing song is never evicted.
+A decoded song's size is measured as the growth of the heap while it loads.  Songs load one at a time, but memory that the game
+allocates or frees on other threads meanwhile is counted too, so the sizes are estimates and the budget can be over- or under-enforced.
+@param bytes The budget in bytes, or 0 for no limit.  The default is 0.
+*/
+extern "C" DLL_EXPORT void SetMusicMemoryBudget(int bytes);
+/*
+@desc Sets which songs loaded from now on are compiled into register streams when they are decoded.
+Decoding plays the song through once while recording the register writes.  Playback then only replays the writes,
+so the original player's sequencing costs nothing, the duration is exact, and seeking is instant.
+Compiled songs use more memory than their patterns, since every write is stored.
+Compiling happens while the song is decoded, so it adds to the load time.
+Songs with more than one subsong, songs that don't end within ten minutes, and register captures are played normally.
+@param mode 0 to compile no songs, 1 to compile every song, or 2 to compile only formats whose players do the most work per tick,
+such as trackers.  The default is 0.
+*/
+extern "C" DLL_EXPORT void SetMusicPrecompile(int mode);
+/*
+@desc Sets whether the emulator is swapped for a cheaper one while rendering the music takes too long.
+Each buffer's render time is measured.  After a couple of slow buffers, the music moves to a cheaper emulator that supports
+the song's chip: from Nuked to DOSBox, and for OPL2 songs, on to Ken Silverman's.  After several seconds of fast buffers, it
+moves back one step, up to the emulator the song started on.  Dual OPL songs always play on Dual OPL.
+An emulator that can't be created is logged once and skipped until scaling is enabled again.
+The chip's registers are copied to the new emulator, so the music carries on without a gap, though held notes restart.
+Use GetMusicEmulator to see the emulator in use.
+@param enabled 1 to scale quality with render time; 0 to keep one emulator.  The default is 0.
+*/
+extern "C" DLL_EXPORT void SetMusicQualityScaling(int enabled);
+/*
+@desc Sets a folder where songs compiled by SetMusicPrecompile are saved, named after a hash of the song's content
+and the emulator's chip type.
+Songs loaded from then on check the folder first.  When a compiled copy is there, it is played instead of the song,
+so packed formats skip unpacking and no song is compiled twice, even between runs.
+The cache is only used while precompiling is enabled.  Delete the folder's files to clear it.
+@param folder The folder to use, which is created if needed, or an empty string to disable the cache.  The default is disabled.
+*/
+extern "C" DLL_EXPORT void SetMusicStreamCache(const char *folder);
+/*
 @desc Sets the subsong for a song.
 This also resets the seek position for the song to 0.
 
@@ -282,6 +503,13 @@ extern "C" DLL_EXPORT void SetMusicSystemVolume(int volume);
 */
 extern "C" DLL_EXPORT void SetMusicVolume(int songID, int volume);
 /*
+@desc Sets whether register writes that don't change the emulator's state are dropped before they reach the emulator.
+Many players and register captures write the same value to a register again and again, and every write costs
+emulator time.  Key-on and timer writes always reach the emulator.  The output is the same either way.
+@param enabled 1 to drop unchanged writes; 0 to pass every write.  The default is 1.
+*/
+extern "C" DLL_EXPORT void SetMusicWriteFilter(int enabled);
+/*
 @desc Stops music playback.
 */
 extern "C" DLL_EXPORT void StopMusic();
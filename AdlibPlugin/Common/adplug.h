@@ -29,6 +29,12 @@ adplug.h - Groups all AdPlugin includes and library usage together.
 #include "../AdPlug/src/kemuopl.h" // Ken Silverman's emulator.
 #include "../AdPlug/src/temuopl.h" // Tatsuyuki Satoh's emulator.
 #include "../AdPlug/src/emuopl.h"  // Dual OPL.
+#include "../AdPlug/src/protrack.h" // Base of most tracker players.
+#include "../AdPlug/src/s3m.h"
+#include "../AdPlug/src/mid.h" // MIDI, SCI, LAA, and old CMF.
+#include "../AdPlug/src/cmf.h"
+#include "../AdPlug/src/rol.h"
+#include "../AdPlug/src/herad.h"
 
 #if defined(_WINDOWS)
 #if defined(_DEBUG)
@@ -0,0 +1,286 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+archive.cpp - Packed asset archive of songs and external data.
+*/
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <binstr.h>
+#include "archive.h"
+#include "filepath.h"
+#include "lzss.h"
+
+static const char archiveMagic[8] = { 'A', 'D', 'L', 'P', 'A', 'C', 'K', 0x1a };
+static const unsigned long headerSize = 16;
+static const unsigned long indexEntrySize = 24;
+// A match unpacks 2 bytes into at most 18 and every 8 items share a flag byte, so LZSS data never grows more than 9 times.
+static const unsigned long long maxUnpackRatio = 9;
+
+static inline unsigned long ReadUInt32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+static inline void WriteUInt32(FILE *f, unsigned long value)
+{
+	unsigned char bytes[4] = { (unsigned char)value, (unsigned char)(value >> 8), (unsigned char)(value >> 16), (unsigned char)(value >> 24) };
+	fwrite(bytes, 1, sizeof bytes, f);
+}
+
+// Case-insensitive ordering used for the index.
+static int CompareNames(const char *a, unsigned long aLength, const char *b, unsigned long bLength)
+{
+	int result = _strnicmp(a, b, aLength < bLength ? aLength : bLength);
+	if (result == 0)
+	{
+		result = (aLength > bLength) - (aLength < bLength);
+	}
+	return result;
+}
+
+bool ArchiveFileProvider::load(const std::string &path)
+{
+	unload();
+	if (!file.open(path))
+	{
+		return false;
+	}
+	const unsigned char *data = file.data();
+	unsigned long size = file.size();
+	if (size < headerSize || memcmp(data, archiveMagic, sizeof archiveMagic) != 0 || ReadUInt32(data + 8) != ARCHIVE_VERSION)
+	{
+		unload();
+		return false;
+	}
+	unsigned long count = ReadUInt32(data + 12);
+	if (count > (size - headerSize) / indexEntrySize)
+	{
+		unload();
+		return false;
+	}
+	unsigned long namesOffset = headerSize + count * indexEntrySize;
+	entries.reserve(count);
+	for (unsigned long index = 0; index < count; index++)
+	{
+		const unsigned char *p = data + headerSize + index * indexEntrySize;
+		Entry entry;
+		unsigned long nameOffset = ReadUInt32(p);
+		entry.nameLength = ReadUInt32(p + 4);
+		entry.offset = ReadUInt32(p + 8);
+		entry.size = ReadUInt32(p + 12);
+		entry.packedSize = ReadUInt32(p + 16);
+		entry.flags = ReadUInt32(p + 20);
+		// Reject entries that point outside of the archive.
+		if (nameOffset > size - namesOffset || entry.nameLength > size - namesOffset - nameOffset
+			|| entry.offset > size || entry.packedSize > size - entry.offset)
+		{
+			unload();
+			return false;
+		}
+		// Stored entries are served straight from the mapping, and packed entries can't claim more than they could unpack to.
+		if ((entry.flags & ARCHIVE_FLAG_LZSS) ? entry.size > entry.packedSize * maxUnpackRatio : entry.size != entry.packedSize)
+		{
+			unload();
+			return false;
+		}
+		entry.name = (const char *)data + namesOffset + nameOffset;
+		entries.push_back(entry);
+	}
+	return true;
+}
+
+void ArchiveFileProvider::unload()
+{
+	for (auto it = buffers.begin(); it != buffers.end(); it = buffers.erase(it))
+	{
+		delete it->first;
+		delete[] it->second;
+	}
+	entries.clear();
+	file.close();
+}
+
+const ArchiveFileProvider::Entry *ArchiveFileProvider::find(const std::string &filename) const
+{
+	// Binary search the sorted index.
+	size_t low = 0;
+	size_t high = entries.size();
+	while (low < high)
+	{
+		size_t middle = (low + high) / 2;
+		const Entry &entry = entries[middle];
+		int compare = CompareNames(entry.name, entry.nameLength, filename.c_str(), (unsigned long)filename.size());
+		if (compare == 0)
+		{
+			return &entry;
+		}
+		if (compare < 0)
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+	return NULL;
+}
+
+binistream *ArchiveFileProvider::open(std::string filename) const
+{
+	const Entry *entry = find(filename);
+	if (!entry)
+	{
+		// Return null when looking for a file that doesn't exist.
+		return NULL;
+	}
+	binisstream *stream;
+	if (entry->flags & ARCHIVE_FLAG_LZSS)
+	{
+		unsigned char *buffer = new unsigned char[entry->size ? entry->size : 1];
+		if (!lzss::decompress(file.data() + entry->offset, entry->packedSize, buffer, entry->size))
+		{
+			delete[] buffer;
+			return NULL;
+		}
+		stream = new binisstream(buffer, entry->size);
+		buffers.insert({ stream, buffer });
+	}
+	else
+	{
+		// Stored entries are read straight from the mapping.
+		stream = new binisstream((void *)(file.data() + entry->offset), entry->size);
+		buffers.insert({ stream, NULL });
+	}
+	stream->setFlag(binio::FloatIEEE);
+	return stream;
+}
+
+void ArchiveFileProvider::close(binistream *f) const
+{
+	auto it = buffers.find(f);
+	if (it != buffers.end())
+	{
+		delete it->first;
+		delete[] it->second;
+		buffers.erase(it);
+	}
+}
+
+static std::string GetFullPath(const std::string &path)
+{
+	char fullPath[MAX_PATH];
+	DWORD length = GetFullPathNameA(path.c_str(), sizeof fullPath, fullPath, NULL);
+	if (length == 0 || length >= sizeof fullPath)
+	{
+		return path;
+	}
+	return fullPath;
+}
+
+bool CreateArchive(const std::string &folder, const std::string &path, bool compress)
+{
+	std::vector<std::string> names;
+	ListFiles(folder, names);
+	// The archive can be written into the folder it packs, so don't pack a previous copy of it.
+	std::string fullPath = GetFullPath(path);
+	names.erase(std::remove_if(names.begin(), names.end(), [&](const std::string &name) {
+		return _stricmp(GetFullPath(folder + "/" + name).c_str(), fullPath.c_str()) == 0;
+	}), names.end());
+	std::sort(names.begin(), names.end(), [](const std::string &a, const std::string &b) {
+		return CompareNames(a.c_str(), (unsigned long)a.size(), b.c_str(), (unsigned long)b.size()) < 0;
+	});
+	FILE *f = fopen(path.c_str(), "wb");
+	if (!f)
+	{
+		return false;
+	}
+	// Leave room for the header, index and names.  The index is written once the payload sizes are known.
+	unsigned long namesSize = 0;
+	for (const std::string &name : names)
+	{
+		namesSize += (unsigned long)name.size();
+	}
+	unsigned long offset = headerSize + (unsigned long)names.size() * indexEntrySize + namesSize;
+	std::vector<unsigned long> index;
+	std::vector<unsigned char> packed;
+	bool success = true;
+	for (const std::string &name : names)
+	{
+		MappedFile source;
+		const unsigned char *data = NULL;
+		unsigned long size = 0;
+		// Empty files can't be mapped, but they are still valid entries.
+		if (source.open(folder + "/" + name))
+		{
+			data = source.data();
+			size = source.size();
+		}
+		offset = (offset + ARCHIVE_ALIGNMENT - 1) & ~(ARCHIVE_ALIGNMENT - 1);
+		unsigned long flags = 0;
+		if (compress && size && lzss::compress(data, size, packed))
+		{
+			flags |= ARCHIVE_FLAG_LZSS;
+			data = packed.data();
+		}
+		unsigned long packedSize = (flags & ARCHIVE_FLAG_LZSS) ? (unsigned long)packed.size() : size;
+		if (fseek(f, offset, SEEK_SET) != 0 || fwrite(data, 1, packedSize, f) != packedSize)
+		{
+			success = false;
+			break;
+		}
+		index.push_back(offset);
+		index.push_back(size);
+		index.push_back(packedSize);
+		index.push_back(flags);
+		offset += packedSize;
+	}
+	if (success)
+	{
+		fseek(f, 0, SEEK_SET);
+		fwrite(archiveMagic, 1, sizeof archiveMagic, f);
+		WriteUInt32(f, ARCHIVE_VERSION);
+		WriteUInt32(f, (unsigned long)names.size());
+		unsigned long nameOffset = 0;
+		for (size_t entry = 0; entry < names.size(); entry++)
+		{
+			WriteUInt32(f, nameOffset);
+			WriteUInt32(f, (unsigned long)names[entry].size());
+			for (int field = 0; field < 4; field++)
+			{
+				WriteUInt32(f, index[entry * 4 + field]);
+			}
+			nameOffset += (unsigned long)names[entry].size();
+		}
+		for (const std::string &name : names)
+		{
+			fwrite(name.c_str(), 1, name.size(), f);
+		}
+		success = !ferror(f);
+	}
+	fclose(f);
+	if (!success)
+	{
+		remove(path.c_str());
+	}
+	return success;
+}
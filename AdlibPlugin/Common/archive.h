@@ -0,0 +1,89 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+archive.h - Packed asset archive of songs and external data.
+*/
+
+#ifndef _ARCHIVE_H_
+#define _ARCHIVE_H_
+#pragma once
+
+#include <map>
+#include <vector>
+#include "adplug.h"
+#include "mappedfile.h"
+
+/*
+Archive layout.  All values are little-endian.
+
+Header
+	char[8]		"ADLPACK" followed by 0x1a
+	uint32		version
+	uint32		entry count
+Index, sorted by name (case-insensitive)
+	uint32		name offset within the name table
+	uint32		name length
+	uint32		payload offset within the archive
+	uint32		size of the entry
+	uint32		size of the payload
+	uint32		flags
+Name table
+Payloads, each aligned to ARCHIVE_ALIGNMENT bytes.
+*/
+#define ARCHIVE_VERSION			1
+#define ARCHIVE_ALIGNMENT		16
+#define ARCHIVE_FLAG_LZSS		1
+
+/*
+Serves the entries of an archive file.  The archive stays mapped while the provider is open.
+Entry names are relative paths using forward slashes, so companion files resolve the same way they would from a folder.
+*/
+class ArchiveFileProvider : public CFileProvider
+{
+public:
+	ArchiveFileProvider() {}
+	~ArchiveFileProvider()
+	{
+		unload();
+	}
+	bool load(const std::string &path);
+	void unload();
+	bool hasFile(std::string filename) const { return find(filename) != NULL; }
+	binistream *open(std::string filename) const;
+	void close(binistream *f) const;
+private:
+	struct Entry
+	{
+		const char *name;
+		unsigned long nameLength;
+		unsigned long offset;
+		unsigned long size;
+		unsigned long packedSize;
+		unsigned long flags;
+	};
+	const Entry *find(const std::string &filename) const;
+	MappedFile file;
+	std::vector<Entry> entries;
+	// Unpacked copies of compressed entries, owned by their streams.
+	mutable std::map<binistream*, unsigned char*> buffers;
+};
+
+// Packs every file in a folder and its subfolders into an archive.
+bool CreateArchive(const std::string &folder, const std::string &path, bool compress);
+
+#endif // _ARCHIVE_H_
@@ -0,0 +1,167 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+bankcache.cpp - Shares external data such as instrument banks between songs.
+*/
+
+#include <binstr.h>
+#include "bankcache.h"
+
+BankCacheFileProvider::~BankCacheFileProvider()
+{
+	clear();
+	// Nothing is left to close the streams that are still open.
+	for (auto it = streams.begin(); it != streams.end(); it = streams.erase(it))
+	{
+		delete it->first;
+	}
+	for (Bank *bank : banks)
+	{
+		delete bank;
+	}
+	banks.clear();
+	memoryUsage = 0;
+}
+
+void BankCacheFileProvider::clear()
+{
+	while (!names.empty())
+	{
+		Bank *bank = names.begin()->second;
+		names.erase(names.begin());
+		release(bank);
+	}
+}
+
+void BankCacheFileProvider::removeFile(std::string filename)
+{
+	auto it = names.find(filename);
+	if (it != names.end())
+	{
+		Bank *bank = it->second;
+		names.erase(it);
+		release(bank);
+	}
+}
+
+void BankCacheFileProvider::release(Bank *bank) const
+{
+	if (--bank->nameCount > 0)
+	{
+		return;
+	}
+	// Don't pull the data out from under an open stream.
+	for (auto it = streams.begin(); it != streams.end(); ++it)
+	{
+		if (it->second == bank)
+		{
+			return;
+		}
+	}
+	for (auto it = banks.begin(); it != banks.end(); ++it)
+	{
+		if (*it == bank)
+		{
+			banks.erase(it);
+			break;
+		}
+	}
+	memoryUsage -= (unsigned long)bank->data.size();
+	delete bank;
+}
+
+binistream *BankCacheFileProvider::open(std::string filename) const
+{
+	if (filename == songFile)
+	{
+		return source.open(filename);
+	}
+	Bank *bank;
+	auto it = names.find(filename);
+	if (it != names.end())
+	{
+		bank = it->second;
+	}
+	else
+	{
+		binistream *f = source.open(filename);
+		if (!f)
+		{
+			return NULL;
+		}
+		// Read the whole file once.  Read to the end instead of asking for the size, which not every stream reports the same way.
+		std::vector<unsigned char> data;
+		f->seek(0);
+		for (;;)
+		{
+			unsigned char value = (unsigned char)f->readInt(1);
+			if (f->eof())
+			{
+				break;
+			}
+			data.push_back(value);
+		}
+		source.close(f);
+		binisstream hashStream(data.size() ? data.data() : NULL, (unsigned long)data.size());
+		CAdPlugDatabase::CKey key(hashStream);
+		// Share the data with any file that has the same content.
+		bank = NULL;
+		for (Bank *cached : banks)
+		{
+			if (cached->key.crc16 == key.crc16 && cached->key.crc32 == key.crc32 && cached->data == data)
+			{
+				bank = cached;
+				break;
+			}
+		}
+		if (!bank)
+		{
+			bank = new Bank();
+			bank->key = key;
+			bank->data.swap(data);
+			bank->nameCount = 0;
+			banks.push_back(bank);
+			memoryUsage += (unsigned long)bank->data.size();
+		}
+		bank->nameCount++;
+		names.insert({ filename, bank });
+	}
+	binisstream *stream = new binisstream(bank->data.data(), (unsigned long)bank->data.size());
+	stream->setFlag(binio::FloatIEEE);
+	streams.insert({ stream, bank });
+	return stream;
+}
+
+void BankCacheFileProvider::close(binistream *f) const
+{
+	auto it = streams.find(f);
+	if (it == streams.end())
+	{
+		source.close(f);
+		return;
+	}
+	Bank *bank = it->second;
+	delete it->first;
+	streams.erase(it);
+	// Finish removing a bank whose names were removed while it was open.
+	if (bank->nameCount == 0)
+	{
+		bank->nameCount++;
+		release(bank);
+	}
+}
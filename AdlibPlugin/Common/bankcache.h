@@ -0,0 +1,69 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+bankcache.h - Shares external data such as instrument banks between songs.
+*/
+
+#ifndef _BANKCACHE_H_
+#define _BANKCACHE_H_
+#pragma once
+
+#include <map>
+#include <vector>
+#include "adplug.h"
+
+/*
+Caches the files that players read from another provider, such as the standard.bnk for ROL files.
+The first read of a file copies it into memory.  After that, every song reads the same copy.
+Files with identical content are only stored once, regardless of their names.
+*/
+class BankCacheFileProvider : public CFileProvider
+{
+public:
+	BankCacheFileProvider(const CFileProvider &source) :
+		source(source),
+		memoryUsage(0)
+	{}
+	~BankCacheFileProvider();
+	// Files with open streams keep their data until the last stream is closed, but can't be opened again.
+	void clear();
+	void removeFile(std::string filename);
+	// The song being loaded is read directly from the source and is never cached.
+	void setSongFile(std::string filename) { songFile = filename; }
+	// The number of bytes held by the cache.
+	unsigned long getMemoryUsage() const { return memoryUsage; }
+	binistream *open(std::string filename) const;
+	void close(binistream *f) const;
+private:
+	struct Bank
+	{
+		CAdPlugDatabase::CKey key;
+		std::vector<unsigned char> data;
+		int nameCount;
+	};
+	void release(Bank *bank) const;
+	const CFileProvider &source;
+	std::string songFile;
+	mutable std::map<std::string, Bank*> names;
+	mutable std::vector<Bank*> banks;
+	// Streams on cached data.  Anything else came from the source.
+	mutable std::map<binistream*, Bank*> streams;
+	mutable unsigned long memoryUsage;
+};
+
+#endif // _BANKCACHE_H_
@@ -0,0 +1,64 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+chainfprovider.cpp - Combines several file providers into one.
+*/
+
+#include <algorithm>
+#include "chainfprovider.h"
+
+void ChainFileProvider::remove(const CFileProvider *provider)
+{
+	providers.erase(std::remove(providers.begin(), providers.end(), provider), providers.end());
+	for (auto it = owners.begin(); it != owners.end();)
+	{
+		if (it->second == provider)
+		{
+			it = owners.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+}
+
+binistream *ChainFileProvider::open(std::string filename) const
+{
+	for (const CFileProvider *provider : providers)
+	{
+		binistream *f = provider->open(filename);
+		if (f)
+		{
+			owners[f] = provider;
+			return f;
+		}
+	}
+	return NULL;
+}
+
+void ChainFileProvider::close(binistream *f) const
+{
+	auto it = owners.find(f);
+	if (it != owners.end())
+	{
+		const CFileProvider *provider = it->second;
+		owners.erase(it);
+		provider->close(f);
+	}
+}
@@ -0,0 +1,49 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+chainfprovider.h - Combines several file providers into one.
+*/
+
+#ifndef _CHAINFPROVIDER_H_
+#define _CHAINFPROVIDER_H_
+#pragma once
+
+#include <initializer_list>
+#include <map>
+#include <vector>
+#include "adplug.h"
+
+/*
+Looks for files in each provider in the order they were added.
+Streams are closed by the provider that opened them.
+*/
+class ChainFileProvider : public CFileProvider
+{
+public:
+	ChainFileProvider() {}
+	ChainFileProvider(std::initializer_list<const CFileProvider*> list) : providers(list) {}
+	void add(const CFileProvider *provider) { providers.push_back(provider); }
+	void remove(const CFileProvider *provider);
+	binistream *open(std::string filename) const;
+	void close(binistream *f) const;
+private:
+	std::vector<const CFileProvider*> providers;
+	mutable std::map<binistream*, const CFileProvider*> owners;
+};
+
+#endif // _CHAINFPROVIDER_H_
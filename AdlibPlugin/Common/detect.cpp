@@ -0,0 +1,177 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+detect.cpp - Picks the players to try for a music file.
+*/
+
+#include <string.h>
+#include <algorithm>
+#include "detect.h"
+
+// Signatures found in file headers and the extensions of the players that read them.
+struct Signature
+{
+	unsigned long offset;
+	const char *magic;
+	unsigned long length;
+	const char *extensions[2];
+};
+
+#define SIGNATURE(offset, magic, ...) { offset, magic, sizeof magic - 1, { __VA_ARGS__ } }
+
+static const Signature signatures[] = {
+	SIGNATURE(0, "_A2module_", ".a2m"),
+	SIGNATURE(0, "RAD by REALiTY!!", ".rad"),
+	SIGNATURE(0, "DBRAWOPL", ".dro"),
+	SIGNATURE(0, "ADLSTRM\x1a", ".ads"),
+	SIGNATURE(0, "Vgm ", ".vgm"),
+	SIGNATURE(0, "\x1f\x8b", ".vgz", ".vgm"),
+	SIGNATURE(0, "CTMF", ".cmf"),
+	SIGNATURE(0, "MThd", ".mid", ".mdi"),
+	SIGNATURE(0, "RAWADATA", ".raw"),
+	SIGNATURE(0, "CBMF", ".bam"),
+	SIGNATURE(0, "XAD!", ".xad"),
+	SIGNATURE(0, "SAdT", ".sa2", ".sat"),
+	SIGNATURE(0, "DFM\x1a", ".dfm"),
+	SIGNATURE(0, "DeFy DTM ", ".dtm"),
+	SIGNATURE(0, "FMC!", ".sng"),
+	SIGNATURE(0, "ObsM", ".sng"),
+	SIGNATURE(0, "MKJamz", ".mkj"),
+	SIGNATURE(0, "<CUD-FM-File>", ".cff"),
+	SIGNATURE(0, "sopepos", ".sop"),
+	SIGNATURE(0, "JCH\x26\x02\x66", ".d00"),
+	SIGNATURE(0, "ofTAZ!", ".xsm"),
+	SIGNATURE(0, "mpu401tr\x92kk\xeer@data", ".mtk"),
+	SIGNATURE(4, "\\roll\\default", ".rol"),
+	SIGNATURE(44, "SCRM", ".s3m"),
+	SIGNATURE(1062, "<o\xefQU\xeeRoR", ".amd"),
+	SIGNATURE(1062, "MaDoKaN96", ".amd"),
+};
+
+// The largest offset + length in the signature table.
+#define SIGNATURE_HEADER_SIZE	1071
+
+static std::string GetExtension(const std::string &filename)
+{
+	size_t period = filename.find_last_of('.');
+	if (period == std::string::npos || filename.find_first_of("/\\", period) != std::string::npos)
+	{
+		return "";
+	}
+	std::string extension = filename.substr(period);
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	return extension;
+}
+
+FormatDetector::FormatDetector(const CPlayers &players) :
+	players(players)
+{
+	for (const CPlayerDesc *player : players)
+	{
+		const char *extension;
+		for (unsigned int index = 0; (extension = player->get_extension(index)) != NULL; index++)
+		{
+			std::vector<const CPlayerDesc *> &list = extensions[GetExtension(extension)];
+			if (std::find(list.begin(), list.end(), player) == list.end())
+			{
+				list.push_back(player);
+			}
+		}
+	}
+}
+
+// Adds a player to the list if it isn't already there.
+static void AddCandidate(std::vector<const CPlayerDesc *> &candidates, const CPlayerDesc *player)
+{
+	if (std::find(candidates.begin(), candidates.end(), player) == candidates.end())
+	{
+		candidates.push_back(player);
+	}
+}
+
+std::vector<const CPlayerDesc *> FormatDetector::getCandidates(const std::string &filename, binistream *f, CAdPlugDatabase::CKey &key) const
+{
+	std::vector<const CPlayerDesc *> candidates;
+	candidates.reserve(players.size());
+	// The content key, which also reads the whole file.
+	f->seek(0);
+	key = CAdPlugDatabase::CKey(*f);
+	auto last = lastPlayers.find(std::make_pair(key.crc16, key.crc32));
+	if (last != lastPlayers.end())
+	{
+		candidates.push_back(last->second);
+	}
+	addLikelyPlayers(filename, f, candidates);
+	for (const CPlayerDesc *player : players)
+	{
+		AddCandidate(candidates, player);
+	}
+	return candidates;
+}
+
+std::vector<const CPlayerDesc *> FormatDetector::getLikelyPlayers(const std::string &filename, binistream *f) const
+{
+	std::vector<const CPlayerDesc *> candidates;
+	addLikelyPlayers(filename, f, candidates);
+	return candidates;
+}
+
+void FormatDetector::addLikelyPlayers(const std::string &filename, binistream *f, std::vector<const CPlayerDesc *> &candidates) const
+{
+	auto addExtension = [this, &candidates](const std::string &extension) {
+		auto it = extensions.find(extension);
+		if (it != extensions.end())
+		{
+			for (const CPlayerDesc *player : it->second)
+			{
+				AddCandidate(candidates, player);
+			}
+		}
+	};
+	// Sniff the header.
+	unsigned char header[SIGNATURE_HEADER_SIZE];
+	unsigned long headerSize = 0;
+	f->seek(0);
+	// Clear any error left by an earlier read to the end of the file.
+	f->error();
+	while (headerSize < sizeof header)
+	{
+		unsigned char value = (unsigned char)f->readInt(1);
+		if (f->eof())
+		{
+			break;
+		}
+		header[headerSize++] = value;
+	}
+	f->seek(0);
+	f->error();
+	for (const Signature &signature : signatures)
+	{
+		if (signature.offset + signature.length <= headerSize && memcmp(header + signature.offset, signature.magic, signature.length) == 0)
+		{
+			for (const char *extension : signature.extensions)
+			{
+				if (extension)
+				{
+					addExtension(extension);
+				}
+			}
+		}
+	}
+	addExtension(GetExtension(filename));
+}
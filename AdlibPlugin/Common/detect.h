@@ -0,0 +1,55 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+detect.h - Picks the players to try for a music file.
+*/
+
+#ifndef _DETECT_H_
+#define _DETECT_H_
+#pragma once
+
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include "adplug.h"
+
+/*
+Orders the players so that the one most likely to load a file is tried first.
+The player that last loaded the same content comes first, then players whose signature is in the header,
+then players registered for the file extension, then every other player.
+*/
+class FormatDetector
+{
+public:
+	FormatDetector(const CPlayers &players);
+	// Returns every player exactly once, best guess first.  Also returns the content key for remember().
+	std::vector<const CPlayerDesc *> getCandidates(const std::string &filename, binistream *f, CAdPlugDatabase::CKey &key) const;
+	// Returns only the players that match the header signature or the extension.  Only the header is read.
+	std::vector<const CPlayerDesc *> getLikelyPlayers(const std::string &filename, binistream *f) const;
+	// Records which player loaded the content.
+	void remember(const CAdPlugDatabase::CKey &key, const CPlayerDesc *player) { lastPlayers[std::make_pair(key.crc16, key.crc32)] = player; }
+	void clear() { lastPlayers.clear(); }
+private:
+	void addLikelyPlayers(const std::string &filename, binistream *f, std::vector<const CPlayerDesc *> &candidates) const;
+	const CPlayers &players;
+	// Lowercase extension with the leading period.
+	std::unordered_map<std::string, std::vector<const CPlayerDesc *>> extensions;
+	std::map<std::pair<unsigned short, unsigned long>, const CPlayerDesc *> lastPlayers;
+};
+
+#endif // _DETECT_H_
@@ -0,0 +1,91 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+emupool.cpp - Keeps emulator instances for reuse.
+*/
+
+#include "emupool.h"
+#include "DllMain.h"
+
+Copl *EmulatorPool::Create(int type, int sampleRate)
+{
+	switch (type)
+	{
+	case OPL_NUKED:
+		return new CNemuopl(sampleRate);
+	case OPL_DOSBOX:
+		return new CWemuopl(sampleRate, true, true);
+	case OPL_SILVERMAN:
+		// adlibemu keeps its chip in process-wide variables, so every CKemuopl plays through the same chip and init() resets it for all of them.
+		// That's only safe because the plugin renders through one emulator at a time.
+		return new CKemuopl(sampleRate, true, true);
+	case OPL_SATOH:
+		return new CTemuopl(sampleRate, true, true);
+	case OPL_DUAL:
+		return new CEmuopl(sampleRate, true, true);
+	}
+	return NULL;
+}
+
+Copl *EmulatorPool::acquire(int type)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	auto it = idle.find(type);
+	if (it != idle.end())
+	{
+		Copl *emulator = it->second;
+		idle.erase(it);
+		emulator->init();
+		return emulator;
+	}
+	Copl *emulator = Create(type, sampleRate);
+	if (emulator)
+	{
+		types[emulator] = type;
+	}
+	return emulator;
+}
+
+void EmulatorPool::release(Copl *emulator)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	auto it = types.find(emulator);
+	if (it == types.end())
+	{
+		return;
+	}
+	idle.insert(std::make_pair(it->second, emulator));
+}
+
+int EmulatorPool::getType(Copl *emulator)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	auto it = types.find(emulator);
+	return it == types.end() ? 0 : it->second;
+}
+
+void EmulatorPool::clear()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	for (auto &entry : idle)
+	{
+		types.erase(entry.second);
+		delete entry.second;
+	}
+	idle.clear();
+}
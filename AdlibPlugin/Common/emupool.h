@@ -0,0 +1,66 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+emupool.h - Keeps emulator instances for reuse.
+*/
+
+#ifndef _EMUPOOL_H_
+#define _EMUPOOL_H_
+#pragma once
+
+#include <map>
+#include <mutex>
+#include "adplug.h"
+
+/*
+Creates emulators by type and keeps released ones for reuse.
+The emulators build their tables and allocate their chip state when they are created, which costs much more than init().
+A released emulator is initialized again when it's acquired, so it starts silent like a new one.
+Pooling saves that creation cost, not memory.  The tables live inside the prebuilt emulators, so each instance still has its own:
+about 20 KB of chip state for Nuked, 8 KB for DOSBox, and 5 KB of rate tables per chip for Satoh.
+Emulators still held when the pool is cleared or destroyed are left to their holders.
+*/
+class EmulatorPool
+{
+public:
+	EmulatorPool(int sampleRate) :
+		sampleRate(sampleRate)
+	{}
+	~EmulatorPool()
+	{
+		clear();
+	}
+	// Returns an emulator of the given OPL_ type, or NULL if the type is unknown or the emulator couldn't be created.
+	Copl *acquire(int type);
+	// Returns an emulator from acquire() to the pool.
+	void release(Copl *emulator);
+	// The OPL_ type of an emulator from acquire(), or 0.
+	int getType(Copl *emulator);
+	// Deletes the emulators that aren't held.
+	void clear();
+private:
+	static Copl *Create(int type, int sampleRate);
+	int sampleRate;
+	std::mutex lock;
+	// Released emulators by type.
+	std::multimap<int, Copl *> idle;
+	// The type of every emulator that the pool created and hasn't deleted.
+	std::map<Copl *, int> types;
+};
+
+#endif // _EMUPOOL_H_
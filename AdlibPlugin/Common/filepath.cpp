@@ -0,0 +1,149 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+filepath.cpp - Resolves AGK file names to paths on disk.
+*/
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include "filepath.h"
+#include "..\AGKLibraryCommands.h"
+
+// Copies an AGK string and deletes the original.
+static std::string TakeString(char *str)
+{
+	std::string result = str ? str : "";
+	if (str)
+	{
+		agk::DeleteString(str);
+	}
+	return result;
+}
+
+static bool PathExists(const std::string &path, bool folder)
+{
+	DWORD attributes = GetFileAttributesA(path.c_str());
+	return attributes != INVALID_FILE_ATTRIBUTES && !(attributes & FILE_ATTRIBUTE_DIRECTORY) == !folder;
+}
+
+// Joins a base path and a relative path with a single separator.
+static std::string JoinPath(std::string base, const std::string &path)
+{
+	if (base.size() && base.back() != '/' && base.back() != '\\')
+	{
+		base.append("/");
+	}
+	return base.append(path);
+}
+
+// Returns the path relative to the AGK read and write folders.
+static std::string GetMediaPath(const std::string &filename)
+{
+	// A leading slash is relative to the media folder, otherwise to the current folder.
+	if (filename.size() && (filename[0] == '/' || filename[0] == '\\'))
+	{
+		return JoinPath("media", filename.substr(1));
+	}
+	return JoinPath(JoinPath("media", TakeString(agk::GetFolder())), filename);
+}
+
+static std::string GetReadablePath(const std::string &filename, bool folder)
+{
+	if (filename.compare(0, 4, "raw:") == 0)
+	{
+		std::string path = filename.substr(4);
+		return PathExists(path, folder) ? path : "";
+	}
+	std::string relative = GetMediaPath(filename);
+	std::string path = JoinPath(TakeString(agk::GetWritePath()), relative);
+	if (PathExists(path, folder))
+	{
+		return path;
+	}
+	path = JoinPath(TakeString(agk::GetReadPath()), relative);
+	if (PathExists(path, folder))
+	{
+		return path;
+	}
+	return "";
+}
+
+std::string GetReadableFilePath(const std::string &filename)
+{
+	return GetReadablePath(filename, false);
+}
+
+std::string GetReadableFolderPath(const std::string &folder)
+{
+	return GetReadablePath(folder, true);
+}
+
+std::string GetWritableFilePath(const std::string &filename)
+{
+	std::string path;
+	if (filename.compare(0, 4, "raw:") == 0)
+	{
+		path = filename.substr(4);
+	}
+	else
+	{
+		path = JoinPath(TakeString(agk::GetWritePath()), GetMediaPath(filename));
+	}
+	// Create each missing folder along the way.
+	for (size_t index = path.find_first_of("/\\", 1); index != std::string::npos; index = path.find_first_of("/\\", index + 1))
+	{
+		std::string folder = path.substr(0, index);
+		if (folder.back() != ':' && !PathExists(folder, true))
+		{
+			CreateDirectoryA(folder.c_str(), NULL);
+		}
+	}
+	return path;
+}
+
+static void ListFiles(const std::string &root, const std::string &folder, std::vector<std::string> &names)
+{
+	WIN32_FIND_DATAA data;
+	HANDLE find = FindFirstFileA((root + "/" + folder + "*").c_str(), &data);
+	if (find == INVALID_HANDLE_VALUE)
+	{
+		return;
+	}
+	do
+	{
+		std::string name = data.cFileName;
+		if (name == "." || name == "..")
+		{
+			continue;
+		}
+		if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+		{
+			ListFiles(root, folder + name + "/", names);
+		}
+		else
+		{
+			names.push_back(folder + name);
+		}
+	} while (FindNextFileA(find, &data));
+	FindClose(find);
+}
+
+void ListFiles(const std::string &folder, std::vector<std::string> &names)
+{
+	ListFiles(folder, "", names);
+}
@@ -0,0 +1,39 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+filepath.h - Resolves AGK file names to paths on disk.
+*/
+
+#ifndef _FILEPATH_H_
+#define _FILEPATH_H_
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Returns the path on disk for an AGK file name that can be read, or an empty string if it can't be found.
+// Follows AGK's rules: "raw:" paths are used as-is, otherwise the write folder is checked before the read folder.
+std::string GetReadableFilePath(const std::string &filename);
+// Same as GetReadableFilePath, but for folders.
+std::string GetReadableFolderPath(const std::string &folder);
+// Returns the path on disk where AGK would write the given file name.  Missing folders are created.
+std::string GetWritableFilePath(const std::string &filename);
+// Adds the names of every file under the folder on disk, including subfolders, relative to the folder.
+void ListFiles(const std::string &folder, std::vector<std::string> &names);
+
+#endif // _FILEPATH_H_
@@ -0,0 +1,513 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+inflate.cpp - Reads gzip-compressed data as it is decompressed.
+*/
+
+#include <string.h>
+#include "inflate.h"
+
+#define GZIP_FLAG_HCRC		0x02
+#define GZIP_FLAG_EXTRA		0x04
+#define GZIP_FLAG_NAME		0x08
+#define GZIP_FLAG_COMMENT	0x10
+
+// Base values and extra bits for the length and distance symbols.
+static const short lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const short lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const unsigned short distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+	4097, 6145, 8193, 12289, 16385, 24577 };
+static const short distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+// The order that code length code lengths are stored in.
+static const short codeLengthOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+InflateStream::InflateStream(binistream *source) :
+	source(source),
+	bitBuffer(0),
+	bitCount(0),
+	state(STATE_BLOCK),
+	lastBlock(false),
+	storedLeft(0),
+	copyLength(0),
+	copyDistance(0),
+	window(INFLATE_WINDOW_SIZE),
+	outputPos(0),
+	readPos(0)
+{
+	setFlag(binio::FloatIEEE);
+	valid = readHeader();
+	if (!valid)
+	{
+		state = STATE_DONE;
+		return;
+	}
+	// The start of the data needs no window.
+	Checkpoint start;
+	start.inputPos = source->pos();
+	start.bitBuffer = 0;
+	start.bitCount = 0;
+	start.outputPos = 0;
+	checkpoints.push_back(start);
+}
+
+bool InflateStream::IsGzip(binistream *f)
+{
+	f->seek(0);
+	f->error();
+	bool gzip = f->readInt(1) == 0x1f && f->readInt(1) == 0x8b && !f->error();
+	f->seek(0);
+	f->error();
+	return gzip;
+}
+
+bool InflateStream::readHeader()
+{
+	if (!IsGzip(source))
+	{
+		return false;
+	}
+	source->ignore(2);
+	// Only deflate is defined.
+	if (source->readInt(1) != 8)
+	{
+		return false;
+	}
+	int flags = (int)source->readInt(1);
+	// Skip the modification time, extra flags, and operating system.
+	source->ignore(6);
+	if (flags & GZIP_FLAG_EXTRA)
+	{
+		source->ignore((unsigned long)source->readInt(2));
+	}
+	if (flags & GZIP_FLAG_NAME)
+	{
+		while (source->readInt(1) != 0 && !source->eof());
+	}
+	if (flags & GZIP_FLAG_COMMENT)
+	{
+		while (source->readInt(1) != 0 && !source->eof());
+	}
+	if (flags & GZIP_FLAG_HCRC)
+	{
+		source->ignore(2);
+	}
+	return !source->error();
+}
+
+// Returns -1 when the source runs out.
+int InflateStream::getBits(int count)
+{
+	while (bitCount < count)
+	{
+		unsigned long value = (unsigned long)source->readInt(1);
+		if (source->eof())
+		{
+			return -1;
+		}
+		bitBuffer |= (value & 0xff) << bitCount;
+		bitCount += 8;
+	}
+	int bits = (int)(bitBuffer & ((1UL << count) - 1));
+	bitBuffer >>= count;
+	bitCount -= count;
+	return bits;
+}
+
+// Reads one symbol a bit at a time.  Returns -1 on an invalid code or the end of the source.
+int InflateStream::decode(const Huffman &huffman)
+{
+	int code = 0;
+	int first = 0;
+	int index = 0;
+	for (int length = 1; length < 16; length++)
+	{
+		int bit = getBits(1);
+		if (bit < 0)
+		{
+			return -1;
+		}
+		code |= bit;
+		int count = huffman.count[length];
+		if (code - count < first)
+		{
+			return huffman.symbol[index + (code - first)];
+		}
+		index += count;
+		first += count;
+		first <<= 1;
+		code <<= 1;
+	}
+	return -1;
+}
+
+// Returns 0 for a complete code, a negative value when over-subscribed, or a positive value when incomplete.
+int InflateStream::construct(Huffman &huffman, const short *lengths, int count)
+{
+	memset(huffman.count, 0, sizeof huffman.count);
+	for (int symbol = 0; symbol < count; symbol++)
+	{
+		huffman.count[lengths[symbol]]++;
+	}
+	if (huffman.count[0] == count)
+	{
+		return 0;
+	}
+	int left = 1;
+	for (int length = 1; length < 16; length++)
+	{
+		left <<= 1;
+		left -= huffman.count[length];
+		if (left < 0)
+		{
+			return left;
+		}
+	}
+	short offsets[16];
+	offsets[1] = 0;
+	for (int length = 1; length < 15; length++)
+	{
+		offsets[length + 1] = offsets[length] + huffman.count[length];
+	}
+	for (int symbol = 0; symbol < count; symbol++)
+	{
+		if (lengths[symbol] != 0)
+		{
+			huffman.symbol[offsets[lengths[symbol]]++] = (short)symbol;
+		}
+	}
+	return left;
+}
+
+bool InflateStream::readDynamicCodes()
+{
+	int lengthCount = getBits(5) + 257;
+	int distanceCount = getBits(5) + 1;
+	int codeCount = getBits(4) + 4;
+	if (lengthCount > 286 || distanceCount > 30 || codeCount < 4)
+	{
+		return false;
+	}
+	short lengths[320];
+	int index;
+	for (index = 0; index < codeCount; index++)
+	{
+		int length = getBits(3);
+		if (length < 0)
+		{
+			return false;
+		}
+		lengths[codeLengthOrder[index]] = (short)length;
+	}
+	for (; index < 19; index++)
+	{
+		lengths[codeLengthOrder[index]] = 0;
+	}
+	// The code length codes go in lengthCodes for now.
+	if (construct(lengthCodes, lengths, 19) != 0)
+	{
+		return false;
+	}
+	index = 0;
+	while (index < lengthCount + distanceCount)
+	{
+		int symbol = decode(lengthCodes);
+		if (symbol < 0)
+		{
+			return false;
+		}
+		if (symbol < 16)
+		{
+			lengths[index++] = (short)symbol;
+			continue;
+		}
+		short length = 0;
+		int repeat;
+		if (symbol == 16)
+		{
+			if (index == 0)
+			{
+				return false;
+			}
+			length = lengths[index - 1];
+			repeat = 3 + getBits(2);
+		}
+		else if (symbol == 17)
+		{
+			repeat = 3 + getBits(3);
+		}
+		else
+		{
+			repeat = 11 + getBits(7);
+		}
+		if (repeat < 3 || index + repeat > lengthCount + distanceCount)
+		{
+			return false;
+		}
+		while (repeat--)
+		{
+			lengths[index++] = length;
+		}
+	}
+	// There has to be an end of block code.
+	if (lengths[256] == 0)
+	{
+		return false;
+	}
+	// Incomplete codes are only allowed when there is a single code.
+	int result = construct(lengthCodes, lengths, lengthCount);
+	if (result < 0 || (result > 0 && lengthCount - lengthCodes.count[0] != 1))
+	{
+		return false;
+	}
+	result = construct(distanceCodes, lengths + lengthCount, distanceCount);
+	if (result < 0 || (result > 0 && distanceCount - distanceCodes.count[0] != 1))
+	{
+		return false;
+	}
+	return true;
+}
+
+// The fixed literal/length code has 288 symbols with lengths 8, 9, 7, and 8 by range.  Every fixed distance code is 5 bits.
+InflateStream::Huffman InflateStream::BuildFixedCodes(bool distances)
+{
+	short lengths[288];
+	int count = distances ? 30 : 288;
+	for (int symbol = 0; symbol < count; symbol++)
+	{
+		lengths[symbol] = distances ? 5 : symbol < 144 ? 8 : symbol < 256 ? 9 : symbol < 280 ? 7 : 8;
+	}
+	Huffman huffman;
+	construct(huffman, lengths, count);
+	return huffman;
+}
+
+bool InflateStream::startBlock()
+{
+	if (lastBlock)
+	{
+		return false;
+	}
+	if (outputPos >= checkpoints.back().outputPos + INFLATE_CHECKPOINT_INTERVAL)
+	{
+		addCheckpoint();
+	}
+	lastBlock = getBits(1) == 1;
+	switch (getBits(2))
+	{
+	case 0:
+	{
+		// Stored blocks start on a byte boundary.
+		getBits(bitCount % 8);
+		int length = getBits(16);
+		int complement = getBits(16);
+		if (length < 0 || complement < 0 || length != (~complement & 0xffff))
+		{
+			return false;
+		}
+		storedLeft = (unsigned long)length;
+		state = STATE_STORED;
+		return true;
+	}
+	case 1:
+	{
+		// Built once.  Function statics are thread-safe, and library scans decompress on several threads.
+		static const Huffman fixedLengthCodes = BuildFixedCodes(false);
+		static const Huffman fixedDistanceCodes = BuildFixedCodes(true);
+		lengthCodes = fixedLengthCodes;
+		distanceCodes = fixedDistanceCodes;
+		state = STATE_CODES;
+		return true;
+	}
+	case 2:
+		if (!readDynamicCodes())
+		{
+			return false;
+		}
+		state = STATE_CODES;
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool InflateStream::step()
+{
+	switch (state)
+	{
+	case STATE_BLOCK:
+		if (!startBlock())
+		{
+			state = STATE_DONE;
+			return false;
+		}
+		return true;
+	case STATE_STORED:
+	{
+		if (storedLeft == 0)
+		{
+			state = STATE_BLOCK;
+			return true;
+		}
+		int value = getBits(8);
+		if (value < 0)
+		{
+			state = STATE_DONE;
+			return false;
+		}
+		put((unsigned char)value);
+		storedLeft--;
+		return true;
+	}
+	case STATE_CODES:
+	{
+		if (copyLength)
+		{
+			put(window[(outputPos - copyDistance) % INFLATE_WINDOW_SIZE]);
+			copyLength--;
+			return true;
+		}
+		int symbol = decode(lengthCodes);
+		if (symbol < 0)
+		{
+			state = STATE_DONE;
+			return false;
+		}
+		if (symbol < 256)
+		{
+			put((unsigned char)symbol);
+			return true;
+		}
+		if (symbol == 256)
+		{
+			state = STATE_BLOCK;
+			return true;
+		}
+		symbol -= 257;
+		if (symbol >= 29)
+		{
+			state = STATE_DONE;
+			return false;
+		}
+		int extra = getBits(lengthExtra[symbol]);
+		int distanceSymbol = decode(distanceCodes);
+		if (extra < 0 || distanceSymbol < 0 || distanceSymbol >= 30)
+		{
+			state = STATE_DONE;
+			return false;
+		}
+		int distanceBits = getBits(distanceExtra[distanceSymbol]);
+		if (distanceBits < 0)
+		{
+			state = STATE_DONE;
+			return false;
+		}
+		copyLength = (unsigned long)(lengthBase[symbol] + extra);
+		copyDistance = (unsigned long)distanceBase[distanceSymbol] + (unsigned long)distanceBits;
+		if (copyDistance > outputPos)
+		{
+			state = STATE_DONE;
+			return false;
+		}
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
+void InflateStream::addCheckpoint()
+{
+	Checkpoint checkpoint;
+	checkpoint.inputPos = source->pos();
+	checkpoint.bitBuffer = bitBuffer;
+	checkpoint.bitCount = bitCount;
+	checkpoint.outputPos = outputPos;
+	checkpoint.window = window;
+	checkpoints.push_back(checkpoint);
+}
+
+void InflateStream::restore(const Checkpoint &checkpoint)
+{
+	source->seek(checkpoint.inputPos);
+	source->error();
+	bitBuffer = checkpoint.bitBuffer;
+	bitCount = checkpoint.bitCount;
+	outputPos = checkpoint.outputPos;
+	if (!checkpoint.window.empty())
+	{
+		window = checkpoint.window;
+	}
+	state = STATE_BLOCK;
+	lastBlock = false;
+	copyLength = 0;
+	readPos = outputPos;
+}
+
+void InflateStream::seek(long amount, Offset by)
+{
+	err &= ~Eof;
+	if (!valid)
+	{
+		return;
+	}
+	long target;
+	switch (by)
+	{
+	case Offset::Add:
+		target = (long)readPos + amount;
+		break;
+	case Offset::End:
+		// The size isn't known until everything has been decompressed.
+		while (step());
+		target = (long)outputPos - amount;
+		break;
+	default:
+		target = amount;
+		break;
+	}
+	if (target < 0)
+	{
+		target = 0;
+	}
+	unsigned long position = (unsigned long)target;
+	if (position < outputPos && outputPos - position > INFLATE_WINDOW_SIZE)
+	{
+		// The data is no longer in the window.  Checkpoints are in output order.
+		size_t index = checkpoints.size() - 1;
+		while (checkpoints[index].outputPos > position)
+		{
+			index--;
+		}
+		restore(checkpoints[index]);
+	}
+	while (outputPos < position && step());
+	readPos = position;
+}
+
+binio::Byte InflateStream::getByte()
+{
+	while (readPos >= outputPos)
+	{
+		if (!step())
+		{
+			err |= Eof;
+			return (Byte)EOF;
+		}
+	}
+	return window[readPos++ % INFLATE_WINDOW_SIZE];
+}
@@ -0,0 +1,107 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+inflate.h - Reads gzip-compressed data as it is decompressed.
+*/
+
+#ifndef _INFLATE_H_
+#define _INFLATE_H_
+#pragma once
+
+#include <vector>
+#include "adplug.h"
+
+// Deflate back-references reach at most this far.
+#define INFLATE_WINDOW_SIZE			32768
+// How much output there is between the points that a backward seek can restart from.
+#define INFLATE_CHECKPOINT_INTERVAL	(1024 * 1024)
+
+/*
+Decompresses a gzip stream as it is read.  Only the last INFLATE_WINDOW_SIZE bytes of output are kept.
+Seeking forward decompresses up to the new position.  Seeking backward restarts from the nearest checkpoint before
+the new position.  A checkpoint is recorded at the first block boundary after every INFLATE_CHECKPOINT_INTERVAL bytes.
+The source stream must stay open while this stream is in use.
+*/
+class InflateStream : public binistream
+{
+public:
+	InflateStream(binistream *source);
+	// Returns false when the source doesn't start with a gzip header.
+	bool isValid() const { return valid; }
+	void seek(long amount, Offset by = Set);
+	long pos() { return (long)readPos; }
+	// Returns true when the source starts with the gzip magic number.  Leaves the source at its start.
+	static bool IsGzip(binistream *f);
+protected:
+	Byte getByte();
+private:
+	// Canonical Huffman code: the number of codes of each length and the symbols in code order.
+	struct Huffman
+	{
+		short count[16];
+		short symbol[288];
+	};
+	// Everything needed to restart decompression at a block boundary.
+	struct Checkpoint
+	{
+		long inputPos;
+		unsigned long bitBuffer;
+		int bitCount;
+		unsigned long outputPos;
+		std::vector<unsigned char> window;
+	};
+	enum State
+	{
+		STATE_BLOCK,
+		STATE_STORED,
+		STATE_CODES,
+		STATE_DONE
+	};
+	bool readHeader();
+	int getBits(int count);
+	int decode(const Huffman &huffman);
+	static int construct(Huffman &huffman, const short *lengths, int count);
+	static Huffman BuildFixedCodes(bool distances);
+	bool startBlock();
+	bool readDynamicCodes();
+	// Decompresses at most one byte.  Returns false at the end of the data or on an error.
+	bool step();
+	void addCheckpoint();
+	void restore(const Checkpoint &checkpoint);
+	void put(unsigned char value) { window[outputPos++ % INFLATE_WINDOW_SIZE] = value; }
+
+	binistream *source;
+	bool valid;
+	unsigned long bitBuffer;
+	int bitCount;
+	State state;
+	bool lastBlock;
+	unsigned long storedLeft;
+	// The part of a back-reference that hasn't been copied yet.
+	unsigned long copyLength;
+	unsigned long copyDistance;
+	Huffman lengthCodes;
+	Huffman distanceCodes;
+	std::vector<unsigned char> window;
+	// Total bytes decompressed and the position of the next byte to read.  readPos is never further back than the window.
+	unsigned long outputPos;
+	unsigned long readPos;
+	std::vector<Checkpoint> checkpoints;
+};
+
+#endif // _INFLATE_H_
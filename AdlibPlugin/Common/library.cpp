@@ -0,0 +1,347 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+library.cpp - Scans music folders into a persistent index of song information and durations.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "library.h"
+#include "filepath.h"
+#include "seekable.h"
+#include "../AdPlug/src/silentopl.h"
+
+static const char indexMagic[8] = { 'A', 'D', 'L', 'I', 'N', 'D', 'E', 'X' };
+// Version 2 stores the player's file type as the format instead of its gettype.
+static const unsigned long indexVersion = 2;
+// Guards against reading a damaged index.
+static const unsigned long maxIndexString = 0x10000;
+
+static void WriteUInt32(FILE *f, unsigned long value)
+{
+	unsigned char bytes[4] = { (unsigned char)value, (unsigned char)(value >> 8), (unsigned char)(value >> 16), (unsigned char)(value >> 24) };
+	fwrite(bytes, 1, sizeof bytes, f);
+}
+
+static void WriteString(FILE *f, const std::string &text)
+{
+	WriteUInt32(f, (unsigned long)text.size());
+	fwrite(text.c_str(), 1, text.size(), f);
+}
+
+static bool ReadUInt32(FILE *f, unsigned long &value)
+{
+	unsigned char bytes[4];
+	if (fread(bytes, 1, sizeof bytes, f) != sizeof bytes)
+	{
+		return false;
+	}
+	value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((unsigned long)bytes[3] << 24);
+	return true;
+}
+
+static bool ReadString(FILE *f, std::string &text)
+{
+	unsigned long size;
+	if (!ReadUInt32(f, size) || size > maxIndexString)
+	{
+		return false;
+	}
+	text.resize(size);
+	return size == 0 || fread(&text[0], 1, size, f) == size;
+}
+
+static std::pair<unsigned short, unsigned long> GetKeyPair(const CAdPlugDatabase::CKey &key)
+{
+	return std::make_pair(key.crc16, key.crc32);
+}
+
+bool MusicLibrary::load(const std::string &path)
+{
+	FILE *f = fopen(path.c_str(), "rb");
+	if (!f)
+	{
+		return false;
+	}
+	char magic[sizeof indexMagic];
+	unsigned long version = 0;
+	unsigned long count = 0;
+	bool success = fread(magic, 1, sizeof magic, f) == sizeof magic && memcmp(magic, indexMagic, sizeof magic) == 0
+		&& ReadUInt32(f, version) && version == indexVersion && ReadUInt32(f, count);
+	std::vector<LibraryEntry> loaded;
+	for (unsigned long index = 0; success && index < count; index++)
+	{
+		LibraryEntry entry;
+		unsigned long crc16, crc32, subsongs;
+		success = ReadUInt32(f, crc16) && ReadUInt32(f, crc32)
+			&& ReadString(f, entry.filename) && ReadString(f, entry.info.format) && ReadString(f, entry.info.title)
+			&& ReadString(f, entry.info.author) && ReadString(f, entry.info.description)
+			&& ReadUInt32(f, subsongs) && subsongs <= maxIndexString;
+		entry.key.crc16 = (unsigned short)crc16;
+		entry.key.crc32 = crc32;
+		for (unsigned long subsong = 0; success && subsong < subsongs; subsong++)
+		{
+			unsigned long duration;
+			success = ReadUInt32(f, duration);
+			entry.durations.push_back(duration);
+		}
+		entry.info.subsongs = (int)entry.durations.size();
+		loaded.push_back(entry);
+	}
+	fclose(f);
+	if (!success)
+	{
+		return false;
+	}
+	std::lock_guard<std::mutex> guard(lock);
+	entries.clear();
+	keys.clear();
+	for (const LibraryEntry &entry : loaded)
+	{
+		merge(entry);
+	}
+	return true;
+}
+
+bool MusicLibrary::save(const std::string &path) const
+{
+	FILE *f = fopen(path.c_str(), "wb");
+	if (!f)
+	{
+		return false;
+	}
+	std::lock_guard<std::mutex> guard(lock);
+	fwrite(indexMagic, 1, sizeof indexMagic, f);
+	WriteUInt32(f, indexVersion);
+	WriteUInt32(f, (unsigned long)entries.size());
+	for (const LibraryEntry &entry : entries)
+	{
+		WriteUInt32(f, entry.key.crc16);
+		WriteUInt32(f, entry.key.crc32);
+		WriteString(f, entry.filename);
+		WriteString(f, entry.info.format);
+		WriteString(f, entry.info.title);
+		WriteString(f, entry.info.author);
+		WriteString(f, entry.info.description);
+		WriteUInt32(f, (unsigned long)entry.durations.size());
+		for (unsigned long duration : entry.durations)
+		{
+			WriteUInt32(f, duration);
+		}
+	}
+	bool success = !ferror(f);
+	fclose(f);
+	if (!success)
+	{
+		remove(path.c_str());
+	}
+	return success;
+}
+
+// Must be called while locked.  Songs with the same content share one entry, so a later file name replaces an earlier one.
+void MusicLibrary::merge(const LibraryEntry &entry)
+{
+	auto it = keys.find(GetKeyPair(entry.key));
+	if (it != keys.end())
+	{
+		entries[it->second] = entry;
+		return;
+	}
+	keys[GetKeyPair(entry.key)] = entries.size();
+	entries.push_back(entry);
+}
+
+bool MusicLibrary::startScan(const std::string &folder, const std::string &prefix, const std::string &indexPath, const FormatDetector &detector,
+	BackgroundWorker &worker, std::recursive_mutex &loaderLock)
+{
+	if (isScanning())
+	{
+		return false;
+	}
+	scan = std::make_shared<ScanState>(this, detector, worker, loaderLock);
+	ListFiles(folder, scan->names);
+	std::sort(scan->names.begin(), scan->names.end());
+	scan->total = (int)scan->names.size();
+	scan->folder = folder;
+	scan->prefix = prefix;
+	scan->indexPath = indexPath;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		for (const LibraryEntry &entry : entries)
+		{
+			scan->known[GetKeyPair(entry.key)] = entry;
+		}
+	}
+	std::shared_ptr<ScanState> state = scan;
+	worker.post([state]() { scanNext(state); });
+	return true;
+}
+
+void MusicLibrary::cancelScan()
+{
+	if (!scan)
+	{
+		return;
+	}
+	{
+		// Waits at most for a merge that is already under way.
+		std::lock_guard<std::mutex> guard(scan->lock);
+		scan->cancel = true;
+		scan->library = NULL;
+	}
+	// The state is kept so that isScanning holds off another scan until the worker is done with it.
+}
+
+float MusicLibrary::getScanProgress() const
+{
+	if (!scan || scan->total == 0)
+	{
+		return isScanning() ? 0.0f : 1.0f;
+	}
+	return scan->done / (float)scan->total;
+}
+
+size_t MusicLibrary::size() const
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return entries.size();
+}
+
+bool MusicLibrary::getEntry(size_t index, LibraryEntry &entry) const
+{
+	std::lock_guard<std::mutex> guard(lock);
+	if (index >= entries.size())
+	{
+		return false;
+	}
+	entry = entries[index];
+	return true;
+}
+
+bool MusicLibrary::findEntry(const CAdPlugDatabase::CKey &key, LibraryEntry &entry) const
+{
+	std::lock_guard<std::mutex> guard(lock);
+	auto it = keys.find(GetKeyPair(key));
+	if (it == keys.end())
+	{
+		return false;
+	}
+	entry = entries[it->second];
+	return true;
+}
+
+/*
+Loads one file and measures every subsong.  Only the players that match the signature or extension are tried,
+so files that aren't music are skipped quickly.  Returns false if no player loads the file.
+*/
+static bool ScanFile(const std::string &path, const CFileProvider &provider, Copl *opl, const FormatDetector &detector,
+	const std::map<std::pair<unsigned short, unsigned long>, LibraryEntry> &known, LibraryEntry &entry)
+{
+	binistream *f = provider.open(path);
+	if (!f)
+	{
+		return false;
+	}
+	entry.key = CAdPlugDatabase::CKey(*f);
+	auto it = known.find(GetKeyPair(entry.key));
+	if (it != known.end())
+	{
+		provider.close(f);
+		entry = it->second;
+		return true;
+	}
+	std::vector<const CPlayerDesc *> players = detector.getLikelyPlayers(path, f);
+	provider.close(f);
+	for (const CPlayerDesc *desc : players)
+	{
+		CPlayer *p = desc->factory(opl);
+		if (!p)
+		{
+			continue;
+		}
+		bool loaded = false;
+		try
+		{
+			loaded = p->load(path, provider);
+			if (loaded)
+			{
+				// Same as ProbeMusicInfo, so the two memblocks agree.
+				entry.info.format = desc->filetype;
+				entry.info.title = p->gettitle();
+				entry.info.author = p->getauthor();
+				entry.info.description = p->getdesc();
+				entry.info.subsongs = p->getsubsongs();
+				for (int subsong = 0; subsong < entry.info.subsongs; subsong++)
+				{
+					entry.durations.push_back(GetSongLength(p, subsong));
+				}
+			}
+		}
+		catch (...)
+		{
+			loaded = false;
+		}
+		delete p;
+		if (loaded)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void MusicLibrary::scanNext(std::shared_ptr<ScanState> state)
+{
+	size_t index = state->done;
+	if (!state->cancel && index < state->names.size())
+	{
+		LibraryEntry entry;
+		bool scanned;
+		{
+			std::lock_guard<std::recursive_mutex> guard(state->loaderLock);
+			CProvider_Filesystem provider;
+			CSilentopl opl;
+			scanned = ScanFile(state->folder + "/" + state->names[index], provider, &opl, state->detector, state->known, entry);
+		}
+		if (scanned)
+		{
+			entry.filename = state->prefix + state->names[index];
+			state->results.push_back(entry);
+		}
+		state->done++;
+		// Queue the next file behind anything posted meanwhile.
+		state->worker.post([state]() { scanNext(state); });
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> stateGuard(state->lock);
+		if (!state->cancel && state->library)
+		{
+			{
+				std::lock_guard<std::mutex> guard(state->library->lock);
+				for (const LibraryEntry &entry : state->results)
+				{
+					state->library->merge(entry);
+				}
+			}
+			state->library->save(state->indexPath);
+		}
+	}
+	state->running = false;
+}
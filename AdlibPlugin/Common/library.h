@@ -0,0 +1,123 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+library.h - Scans music folders into a persistent index of song information and durations.
+*/
+
+#ifndef _LIBRARY_H_
+#define _LIBRARY_H_
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "adplug.h"
+#include "detect.h"
+#include "probe.h"
+#include "worker.h"
+
+struct LibraryEntry
+{
+	// The AGK file name of the song.
+	std::string filename;
+	CAdPlugDatabase::CKey key;
+	MusicInfo info;
+	// In milliseconds, one for each subsong.
+	std::vector<unsigned long> durations;
+};
+
+/*
+An index of songs keyed by the content CRC, so it stays valid when files are renamed or moved.
+Scanning loads each song with a silent OPL and measures every subsong, one file per job on the background worker that also
+prefetches songs, so prefetches queued during a scan wait for one file at most.
+AdPlug's players aren't known to be safe to run side by side, so each file is scanned while holding the loader lock.
+Songs that are already in the index aren't measured again.
+*/
+class MusicLibrary
+{
+public:
+	MusicLibrary() {}
+	~MusicLibrary()
+	{
+		cancelScan();
+	}
+	// Replaces the entries with those in the index file.
+	bool load(const std::string &path);
+	bool save(const std::string &path) const;
+	/*
+	Starts scanning the files in the folder on disk.  prefix is prepended to the names stored in the index.
+	When the scan finishes, the entries are merged into the library and the index is saved to indexPath.
+	Returns false if a scan is already running.
+	*/
+	bool startScan(const std::string &folder, const std::string &prefix, const std::string &indexPath, const FormatDetector &detector,
+		BackgroundWorker &worker, std::recursive_mutex &loaderLock);
+	/*
+	Stops the scan without waiting for the worker, which is safe to call while the loader lock is held.
+	The worker finishes the file it's on and doesn't touch the library again.
+	*/
+	void cancelScan();
+	bool isScanning() const { return scan && scan->running; }
+	// From 0 to 1.
+	float getScanProgress() const;
+	size_t size() const;
+	bool getEntry(size_t index, LibraryEntry &entry) const;
+	bool findEntry(const CAdPlugDatabase::CKey &key, LibraryEntry &entry) const;
+private:
+	// Shared with the worker so that it can outlive a cancelled scan.
+	struct ScanState
+	{
+		ScanState(MusicLibrary *library, const FormatDetector &detector, BackgroundWorker &worker, std::recursive_mutex &loaderLock) :
+			library(library),
+			running(true),
+			cancel(false),
+			total(0),
+			done(0),
+			detector(detector),
+			worker(worker),
+			loaderLock(loaderLock)
+		{}
+		// Held while the results are merged.  The library is only used if the scan wasn't cancelled.
+		std::mutex lock;
+		MusicLibrary *library;
+		std::atomic<bool> running;
+		std::atomic<bool> cancel;
+		int total;
+		std::atomic<int> done;
+		// Only used by the worker after the scan starts.  The detector is a copy so that loading music meanwhile can't change it.
+		std::vector<std::string> names;
+		std::string folder;
+		std::string prefix;
+		std::string indexPath;
+		FormatDetector detector;
+		std::map<std::pair<unsigned short, unsigned long>, LibraryEntry> known;
+		std::vector<LibraryEntry> results;
+		BackgroundWorker worker;
+		std::recursive_mutex &loaderLock;
+	};
+	// Scans the next file and queues the one after it, or merges the results once every file is done.
+	static void scanNext(std::shared_ptr<ScanState> state);
+	void merge(const LibraryEntry &entry);
+	mutable std::mutex lock;
+	std::vector<LibraryEntry> entries;
+	std::map<std::pair<unsigned short, unsigned long>, size_t> keys;
+	std::shared_ptr<ScanState> scan;
+};
+
+#endif // _LIBRARY_H_
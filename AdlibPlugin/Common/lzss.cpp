@@ -0,0 +1,166 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+lzss.cpp - Small LZSS codec for packed song data.
+*/
+
+#include <string.h>
+#include <algorithm>
+#include "lzss.h"
+
+#define LZSS_WINDOW_SIZE	4096
+#define LZSS_MIN_MATCH		3
+#define LZSS_MAX_MATCH		(LZSS_MIN_MATCH + 15)
+#define LZSS_HASH_BITS		12
+#define LZSS_MAX_CHAIN		64
+
+static inline unsigned int Hash(const unsigned char *p)
+{
+	return ((p[0] << 8) ^ (p[1] << 4) ^ p[2]) & ((1 << LZSS_HASH_BITS) - 1);
+}
+
+bool lzss::compress(const unsigned char *data, unsigned long size, std::vector<unsigned char> &output)
+{
+	output.clear();
+	output.reserve(size);
+	// Hash chains of earlier positions that start with the same 3 bytes.
+	// Songs can be compressed on worker threads, so each thread allocates its own tables once and reuses them.
+	static thread_local std::vector<long> head(1 << LZSS_HASH_BITS);
+	static thread_local std::vector<long> chain(LZSS_WINDOW_SIZE);
+	std::fill(head.begin(), head.end(), -1);
+	std::fill(chain.begin(), chain.end(), -1);
+	size_t flagPos = 0;
+	int flagBit = 8;
+	unsigned long pos = 0;
+	while (pos < size)
+	{
+		if (flagBit == 8)
+		{
+			flagPos = output.size();
+			output.push_back(0);
+			flagBit = 0;
+		}
+		unsigned long bestLength = 0;
+		unsigned long bestDistance = 0;
+		if (pos + LZSS_MIN_MATCH <= size)
+		{
+			unsigned long maxLength = size - pos < LZSS_MAX_MATCH ? size - pos : LZSS_MAX_MATCH;
+			long candidate = head[Hash(data + pos)];
+			for (int tries = 0; candidate >= 0 && tries < LZSS_MAX_CHAIN; tries++)
+			{
+				unsigned long distance = pos - candidate;
+				if (distance > LZSS_WINDOW_SIZE)
+				{
+					break;
+				}
+				unsigned long length = 0;
+				while (length < maxLength && data[candidate + length] == data[pos + length])
+				{
+					length++;
+				}
+				if (length > bestLength)
+				{
+					bestLength = length;
+					bestDistance = distance;
+					if (length == maxLength)
+					{
+						break;
+					}
+				}
+				candidate = chain[candidate % LZSS_WINDOW_SIZE];
+			}
+		}
+		unsigned long advance;
+		if (bestLength >= LZSS_MIN_MATCH)
+		{
+			output.push_back((unsigned char)(bestDistance - 1));
+			output.push_back((unsigned char)((((bestDistance - 1) >> 8) << 4) | (bestLength - LZSS_MIN_MATCH)));
+			advance = bestLength;
+		}
+		else
+		{
+			output[flagPos] |= 1 << flagBit;
+			output.push_back(data[pos]);
+			advance = 1;
+		}
+		flagBit++;
+		// Add every position that was passed to the hash chains.
+		for (; advance; advance--, pos++)
+		{
+			if (pos + LZSS_MIN_MATCH <= size)
+			{
+				unsigned int hash = Hash(data + pos);
+				chain[pos % LZSS_WINDOW_SIZE] = head[hash];
+				head[hash] = (long)pos;
+			}
+		}
+		if (output.size() >= size)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool lzss::decompress(const unsigned char *packed, unsigned long packedSize, unsigned char *output, unsigned long size)
+{
+	unsigned long in = 0;
+	unsigned long out = 0;
+	unsigned int flags = 0;
+	int flagBit = 8;
+	while (out < size)
+	{
+		if (flagBit == 8)
+		{
+			if (in >= packedSize)
+			{
+				return false;
+			}
+			flags = packed[in++];
+			flagBit = 0;
+		}
+		if (flags & (1 << flagBit++))
+		{
+			if (in >= packedSize)
+			{
+				return false;
+			}
+			output[out++] = packed[in++];
+		}
+		else
+		{
+			if (in + 2 > packedSize)
+			{
+				return false;
+			}
+			unsigned long distance = (packed[in] | ((packed[in + 1] & 0xf0) << 4)) + 1;
+			unsigned long length = (packed[in + 1] & 0x0f) + LZSS_MIN_MATCH;
+			in += 2;
+			if (distance > out || out + length > size)
+			{
+				return false;
+			}
+			// Matches can overlap the bytes they produce, so copy one byte at a time.
+			for (unsigned char *src = output + out - distance; length; length--)
+			{
+				output[out++] = *src++;
+			}
+		}
+	}
+	return in == packedSize;
+}
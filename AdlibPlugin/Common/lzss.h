@@ -0,0 +1,40 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+lzss.h - Small LZSS codec for packed song data.
+*/
+
+#ifndef _LZSS_H_
+#define _LZSS_H_
+#pragma once
+
+#include <vector>
+
+/*
+Each flag byte describes the next 8 items, lowest bit first.
+A set bit is a literal byte.  A clear bit is a 2-byte match: 12 bits of distance - 1 and 4 bits of length - 3.
+*/
+namespace lzss
+{
+	// Returns false if the data didn't get smaller.
+	bool compress(const unsigned char *data, unsigned long size, std::vector<unsigned char> &output);
+	// Returns false if the packed data is corrupt or doesn't unpack to exactly size bytes.
+	bool decompress(const unsigned char *packed, unsigned long packedSize, unsigned char *output, unsigned long size);
+}
+
+#endif // _LZSS_H_
@@ -0,0 +1,121 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+mapfprovider.cpp - Memory-mapped file provider.
+*/
+
+#include <binstr.h>
+#include "mapfprovider.h"
+
+MappedFileProvider::~MappedFileProvider()
+{
+	clear();
+	// Nothing is left to close the streams that are still open.
+	for (auto it = streams.begin(); it != streams.end(); ++it)
+	{
+		Entry *entry = it->second;
+		delete it->first;
+		if (--entry->openCount == 0)
+		{
+			delete entry;
+		}
+	}
+	streams.clear();
+}
+
+void MappedFileProvider::clear()
+{
+	for (auto it = files.begin(); it != files.end();)
+	{
+		removeFile((it++)->first);
+	}
+}
+
+bool MappedFileProvider::addFile(std::string filename, std::string path)
+{
+	// Don't add if the file already exists in the provider.
+	if (files.find(filename) != files.end())
+	{
+		return false;
+	}
+	Entry *entry = new Entry();
+	entry->path = path;
+	entry->openCount = 0;
+	entry->removed = false;
+	files.insert({ filename, entry });
+	return true;
+}
+
+void MappedFileProvider::removeFile(std::string filename)
+{
+	auto it = files.find(filename);
+	if (it == files.end())
+	{
+		return;
+	}
+	Entry *entry = it->second;
+	files.erase(it);
+	// Don't pull the mapping out from under an open stream.  The last close finishes removing it.
+	if (entry->openCount > 0)
+	{
+		entry->removed = true;
+		return;
+	}
+	delete entry;
+}
+
+binistream *MappedFileProvider::open(std::string filename) const
+{
+	auto it = files.find(filename);
+	if (it == files.end())
+	{
+		// Return null when looking for a file that doesn't exist.
+		return NULL;
+	}
+	Entry *entry = it->second;
+	if (!entry->openCount && !entry->file.open(entry->path))
+	{
+		return NULL;
+	}
+	entry->openCount++;
+	binisstream *stream = new binisstream((void *)entry->file.data(), entry->file.size());
+	stream->setFlag(binio::FloatIEEE);
+	streams.insert({ stream, entry });
+	return stream;
+}
+
+void MappedFileProvider::close(binistream *f) const
+{
+	auto it = streams.find(f);
+	if (it == streams.end())
+	{
+		return;
+	}
+	Entry *entry = it->second;
+	delete it->first;
+	streams.erase(it);
+	// Release the mapping once nothing is viewing it.
+	if (--entry->openCount == 0)
+	{
+		entry->file.close();
+		if (entry->removed)
+		{
+			delete entry;
+		}
+	}
+}
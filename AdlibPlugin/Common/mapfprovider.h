@@ -0,0 +1,67 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+mapfprovider.h - Memory-mapped file provider.
+*/
+
+#ifndef _MAPFPROVIDER_H_
+#define _MAPFPROVIDER_H_
+#pragma once
+
+#include <map>
+#include "adplug.h"
+#include "mappedfile.h"
+
+/*
+Serves files from disk by memory-mapping them.
+Files are only mapped while a stream is open on them, so registering a file costs nothing until it is read.
+*/
+class MappedFileProvider : public CFileProvider
+{
+public:
+	MappedFileProvider() {}
+	~MappedFileProvider();
+	void clear();
+	// Registers a path on disk under the given entry name.
+	bool addFile(std::string filename, std::string path);
+	// Files with open streams stay mapped until the last stream is closed, but can't be opened again.
+	void removeFile(std::string filename);
+	bool hasFile(std::string filename) const { return files.find(filename) != files.end(); }
+	// The path on disk registered for the entry name, or an empty string.
+	std::string getPath(std::string filename) const
+	{
+		auto it = files.find(filename);
+		return it != files.end() ? it->second->path : std::string();
+	}
+	binistream *open(std::string filename) const;
+	void close(binistream *f) const;
+private:
+	struct Entry
+	{
+		std::string path;
+		MappedFile file;
+		int openCount;
+		// Set when the file was removed while streams were open on it.
+		bool removed;
+	};
+	std::map<std::string, Entry*> files;
+	// The entry that each open stream is viewing.
+	mutable std::map<binistream*, Entry*> streams;
+};
+
+#endif // _MAPFPROVIDER_H_
@@ -0,0 +1,74 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+mappedfile.cpp - Read-only memory-mapped file.
+*/
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include "mappedfile.h"
+
+bool MappedFile::open(const std::string &path)
+{
+	close();
+	file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		file = NULL;
+		return false;
+	}
+	LARGE_INTEGER size;
+	// Empty files can't be mapped and files over 4 GB aren't songs.
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0 || size.HighPart != 0)
+	{
+		close();
+		return false;
+	}
+	length = size.LowPart;
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping)
+	{
+		view = (unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	}
+	if (!view)
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (view)
+	{
+		UnmapViewOfFile(view);
+		view = NULL;
+	}
+	if (mapping)
+	{
+		CloseHandle(mapping);
+		mapping = NULL;
+	}
+	if (file)
+	{
+		CloseHandle(file);
+		file = NULL;
+	}
+	length = 0;
+}
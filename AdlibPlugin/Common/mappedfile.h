@@ -0,0 +1,56 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+mappedfile.h - Read-only memory-mapped file.
+*/
+
+#ifndef _MAPPEDFILE_H_
+#define _MAPPEDFILE_H_
+#pragma once
+
+#include <string>
+
+class MappedFile
+{
+public:
+	MappedFile() :
+		file(NULL),
+		mapping(NULL),
+		view(NULL),
+		length(0)
+	{}
+	~MappedFile()
+	{
+		close();
+	}
+	bool open(const std::string &path);
+	void close();
+	bool isOpen() const { return view != NULL; }
+	const unsigned char *data() const { return view; }
+	unsigned long size() const { return length; }
+private:
+	// Not copyable.
+	MappedFile(const MappedFile &);
+	MappedFile &operator=(const MappedFile &);
+	void *file;
+	void *mapping;
+	unsigned char *view;
+	unsigned long length;
+};
+
+#endif // _MAPPEDFILE_H_
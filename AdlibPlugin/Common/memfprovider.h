@@ -39,6 +39,7 @@ public:
 	void clear();
 	bool addFile(std::string filename, unsigned int memID);
 	void removeFile(std::string filename);
+	bool hasFile(std::string filename) const { return files.find(filename) != files.end(); }
 	binistream *open(std::string filename) const;
 	void close(binistream *f) const {}
 private:
@@ -0,0 +1,54 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+memusage.cpp - Measures how much memory a player allocates while loading.
+*/
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <malloc.h>
+#include "memusage.h"
+
+// Only declared by newer SDKs, so it's looked up when first used.
+struct HeapSummaryInfo
+{
+	DWORD cb;
+	SIZE_T cbAllocated;
+	SIZE_T cbCommitted;
+	SIZE_T cbReserved;
+	SIZE_T cbMaxReserve;
+};
+typedef BOOL (WINAPI *HeapSummaryProc)(HANDLE heap, DWORD flags, HeapSummaryInfo *summary);
+
+unsigned long long HeapUsageCounter::GetHeapAllocatedBytes()
+{
+	// Through void * because FARPROC doesn't share the function's signature.
+	static HeapSummaryProc heapSummary = (HeapSummaryProc)(void *)GetProcAddress(GetModuleHandleA("kernel32.dll"), "HeapSummary");
+	if (!heapSummary)
+	{
+		return 0;
+	}
+	HeapSummaryInfo summary = {};
+	summary.cb = sizeof summary;
+	// new and malloc both allocate from the CRT heap.
+	if (!heapSummary((HANDLE)_get_heap_handle(), 0, &summary))
+	{
+		return 0;
+	}
+	return summary.cbAllocated;
+}
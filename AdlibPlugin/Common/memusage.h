@@ -0,0 +1,46 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+memusage.h - Measures how much memory a player allocates while loading.
+*/
+
+#ifndef _MEMUSAGE_H_
+#define _MEMUSAGE_H_
+#pragma once
+
+/*
+Measures how much the CRT heap grew between its construction and getBytes, for charging a decoded player to its song.
+Players load one at a time under the loader lock, so one load is never charged to another.  Anything else that allocates or
+frees meanwhile, such as the game on the main thread, still shifts the figure, so it's an estimate.
+Always 0 on systems without HeapSummary.
+*/
+class HeapUsageCounter
+{
+public:
+	HeapUsageCounter() : start(GetHeapAllocatedBytes()) {}
+	unsigned long getBytes() const
+	{
+		unsigned long long now = GetHeapAllocatedBytes();
+		return now > start ? (unsigned long)(now - start) : 0;
+	}
+private:
+	static unsigned long long GetHeapAllocatedBytes();
+	unsigned long long start;
+};
+
+#endif // _MEMUSAGE_H_
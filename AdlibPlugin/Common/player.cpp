@@ -19,34 +19,65 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 player.cpp - Wrapper for CPlayers to provide some extra functionality.
 */
 
+#include <algorithm>
+#include <vector>
 #include "player.h"
+#include "seekable.h"
 
-void AgkPlayer::Rewind()
+void AgkPlayer::Rewind(bool settle)
 {
-	player->rewind(subsong);
+	data->getPlayer()->rewind(subsong);
 	// ADL starts at subsong 2, so sending subsong -1 will really select subsong 2.
-	subsong = player->getsubsong();
+	subsong = data->getPlayer()->getsubsong();
 	position = 0;
 	if (seekPosition > 0)
 	{
+		float settleStart = settle ? std::max(0.0f, seekPosition - SEEK_SETTLE_TIME) : seekPosition;
+		if (settleStart > 0)
+		{
+			SeekSong(data->getPlayer(), (unsigned long)(settleStart * 1000));
+		}
+		if (settleStart < seekPosition)
+		{
+			Settle(seekPosition - settleStart);
+		}
 		position = seekPosition;
-		player->seek((unsigned long)(seekPosition * 1000));
 		// Clear the seek position for the next call.
 		seekPosition = 0;
 	}
 }
 
+void AgkPlayer::Settle(float seconds)
+{
+	CPlayer *player = data->getPlayer();
+	Copl *opl = data->getOpl();
+	std::vector<short> scratch(SEEK_SETTLE_BLOCK * channels);
+	for (float elapsed = 0; elapsed < seconds && player->update(); )
+	{
+		float refresh = player->getrefresh();
+		if (refresh <= 0)
+		{
+			break;
+		}
+		for (int frames = (int)(sampleRate / refresh); frames > 0; frames -= SEEK_SETTLE_BLOCK)
+		{
+			opl->update(scratch.data(), std::min(frames, SEEK_SETTLE_BLOCK));
+		}
+		elapsed += 1.0f / refresh;
+	}
+}
+
 void AgkPlayer::PlaySound(unsigned int subsong)
 {
-	player->rewind(subsong);
+	data->getPlayer()->rewind(subsong);
 }
 
 bool AgkPlayer::Update()
 {
-	bool result = player->update();
+	bool result = data->getPlayer()->update();
 	if (result)
 	{
-		position += 1.0f / player->getrefresh();
+		position += 1.0f / data->getPlayer()->getrefresh();
 	}
 	return result;
 }
@@ -70,7 +101,7 @@ void AgkPlayer::Seek(float seconds, int mode)
 		return;
 	}
 	// If out of bounds, start at the beginning.
-	if (seekPosition < 0 || seekPosition >= player->songlength())
+	if (seekPosition < 0 || seekPosition >= GetSongLength())
 	{
 		seekPosition = 0;
 	}
@@ -23,48 +23,56 @@ player.h - Wrapper for CPlayers to provide some extra functionality.
 #define _PLAYER_H_
 #pragma once
 
+#include <memory>
 #include "adplug.h"
+#include "song.h"
 #include "utils.h"
 #include "..\AGKLibraryCommands.h"
 
+// Seeks land this many seconds early and play up to the seek position without output.
+#define SEEK_SETTLE_TIME	0.25f
+// The most frames rendered at a time while settling.
+#define SEEK_SETTLE_BLOCK	1024
+
+/*
+A song ID.  Song IDs loaded from identical files share their SongData, but each has its own volume, subsong, and position.
+Everything other than the volume and position requires a successful decode of the data first.
+*/
 class AgkPlayer
 {
 public:
-	AgkPlayer(CPlayer *p) : 
-		player(p), 
+	// The sample rate and channel count are those of the emulator's output.
+	AgkPlayer(std::shared_ptr<SongData> data, int sampleRate, int channels) : 
+		data(data),
+		sampleRate(sampleRate),
+		channels(channels),
 		volume(100),
 		subsong(-1),
 		position(0),
 		seekPosition(0)
 	{}
 
-	~AgkPlayer()
-	{
-		if (player)
-		{
-			delete player;
-			player = NULL;
-		}
-	}
-
-	std::string GetType() { return player->gettype(); }
-	std::string GetTitle() { return player->gettitle(); }
-	std::string GetAuthor() { return player->getauthor(); }
-	std::string GetDescription() { return player->getdesc(); }
+	const std::shared_ptr<SongData> &GetData() { return data; }
+	const CAdPlugDatabase::CKey &GetKey() { return data->getKey(); }
+	std::string GetType() { return data->getPlayer()->gettype(); }
+	std::string GetTitle() { return data->getPlayer()->gettitle(); }
+	std::string GetAuthor() { return data->getPlayer()->getauthor(); }
+	std::string GetDescription() { return data->getPlayer()->getdesc(); }
 
-	float GetRefresh() { return player->getrefresh(); }
-	unsigned int GetSpeed() { return player->getspeed(); }
-	// Rewinds to the last seek position set.  The seek position is then cleared.
-	void Rewind();
+	float GetRefresh() { return data->getPlayer()->getrefresh(); }
+	unsigned int GetSpeed() { return data->getPlayer()->getspeed(); }
+	/*
+	Rewinds to the last seek position set.  The seek position is then cleared.
+	Players only track their own position, so a seek leaves the emulator's envelopes where they were.
+	To fix that, the song is moved to SEEK_SETTLE_TIME before the seek position and played from there to the seek position.
+	The emulator renders that stretch, but the output is thrown away.  Pass false to skip this when the output won't be heard.
+	Rewinding to the start never settles.
+	*/
+	void Rewind(bool settle = true);
 	// Plays a subsong as a sound effect.  Keeps the music looping.
 	void PlaySound(unsigned int subsong);
 	// In seconds.
-	float GetSongLength()
-	{
-		// For ADL files, this will reset the OPL so that songlength(subsong) is accurate.
-		player->rewind();
-		return player->songlength(subsong) / 1000.0f;
-	}
+	float GetSongLength() { return data->getSongLength(GetLengthSubsong()) / 1000.0f; }
 	bool Update();
 	int GetVolume() { return volume; }
 	void SetVolume(int newvolume);
@@ -75,11 +83,17 @@ public:
 
 	// Return our subsong, not player->getsubsong().  player->getsubsong() can change when playing sounds with music (ADL files).
 	unsigned int GetSubsong() { return subsong; } // player->getsubsong();
-	unsigned int GetSubsongCount() { return player->getsubsongs(); }
+	// The subsong that GetSongLength measures.  Before the first rewind, this is the player's default subsong.
+	unsigned int GetLengthSubsong() { return subsong < 0 ? data->getPlayer()->getsubsong() : subsong; }
+	unsigned int GetSubsongCount() { return data->getPlayer()->getsubsongs(); }
 	void SetSubsong(unsigned int newsubsong);
 
 protected:
-	CPlayer *player;
+	// Plays the song for the given number of seconds, discarding the emulator output.
+	void Settle(float seconds);
+	std::shared_ptr<SongData> data;
+	int sampleRate;
+	int channels;
 	int volume;
 	int subsong;
 	float position;
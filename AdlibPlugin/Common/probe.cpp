@@ -0,0 +1,350 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+probe.cpp - Reads song metadata from file headers without loading a player.
+*/
+
+#include <string.h>
+#include <algorithm>
+#include "inflate.h"
+#include "probe.h"
+
+// Reads text from a fixed-size field.  Stops at a null and trims trailing spaces.
+static std::string ReadText(binistream *f, unsigned long offset, unsigned long length)
+{
+	std::string text;
+	f->seek(offset);
+	f->error();
+	for (unsigned long index = 0; index < length; index++)
+	{
+		char value = (char)f->readInt(1);
+		if (f->error() || value == '\0')
+		{
+			break;
+		}
+		text.push_back(value);
+	}
+	text.erase(text.find_last_not_of(' ') + 1);
+	return text;
+}
+
+static bool HasMagic(binistream *f, unsigned long offset, const char *magic)
+{
+	size_t length = strlen(magic);
+	f->seek(offset);
+	f->error();
+	for (size_t index = 0; index < length; index++)
+	{
+		if ((char)f->readInt(1) != magic[index] || f->error())
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Appends a UTF-16 code point to a UTF-8 string.
+static void AppendUTF8(std::string &text, unsigned long code)
+{
+	if (code < 0x80)
+	{
+		text.push_back((char)code);
+	}
+	else if (code < 0x800)
+	{
+		text.push_back((char)(0xc0 | (code >> 6)));
+		text.push_back((char)(0x80 | (code & 0x3f)));
+	}
+	else if (code < 0x10000)
+	{
+		text.push_back((char)(0xe0 | (code >> 12)));
+		text.push_back((char)(0x80 | ((code >> 6) & 0x3f)));
+		text.push_back((char)(0x80 | (code & 0x3f)));
+	}
+	else
+	{
+		text.push_back((char)(0xf0 | (code >> 18)));
+		text.push_back((char)(0x80 | ((code >> 12) & 0x3f)));
+		text.push_back((char)(0x80 | ((code >> 6) & 0x3f)));
+		text.push_back((char)(0x80 | (code & 0x3f)));
+	}
+}
+
+// Reads a null-terminated UTF-16 string from the current position and converts it to UTF-8.
+static std::string ReadWideText(binistream *f)
+{
+	std::string text;
+	for (;;)
+	{
+		unsigned long code = (unsigned long)f->readInt(2);
+		if (f->error() || code == 0)
+		{
+			break;
+		}
+		if (code >= 0xd800 && code < 0xdc00)
+		{
+			unsigned long low = (unsigned long)f->readInt(2);
+			code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+		}
+		AppendUTF8(text, code);
+	}
+	return text;
+}
+
+static bool ReadAMD(binistream *f, MusicInfo &info)
+{
+	if (!HasMagic(f, 1062, "<o\xefQU\xeeRoR") && !HasMagic(f, 1062, "MaDoKaN96"))
+	{
+		return false;
+	}
+	info.title = ReadText(f, 0, 24);
+	info.author = ReadText(f, 24, 24);
+	return true;
+}
+
+// The title, composer, and remarks are null-terminated strings at offsets given in the header.
+static bool ReadCMF(binistream *f, MusicInfo &info)
+{
+	if (!HasMagic(f, 0, "CTMF"))
+	{
+		return false;
+	}
+	f->seek(14);
+	unsigned long titleOffset = (unsigned long)f->readInt(2);
+	unsigned long authorOffset = (unsigned long)f->readInt(2);
+	unsigned long remarksOffset = (unsigned long)f->readInt(2);
+	if (titleOffset)
+	{
+		info.title = ReadText(f, titleOffset, 256);
+	}
+	if (authorOffset)
+	{
+		info.author = ReadText(f, authorOffset, 256);
+	}
+	if (remarksOffset)
+	{
+		info.description = ReadText(f, remarksOffset, 256);
+	}
+	return true;
+}
+
+static bool ReadD00(binistream *f, MusicInfo &info)
+{
+	if (!HasMagic(f, 0, "JCH\x26\x02\x66"))
+	{
+		return false;
+	}
+	f->seek(9);
+	info.subsongs = (int)f->readInt(1);
+	info.title = ReadText(f, 11, 32);
+	info.author = ReadText(f, 43, 32);
+	return true;
+}
+
+// The song info is a Pascal string.
+static bool ReadDFM(binistream *f, MusicInfo &info)
+{
+	if (!HasMagic(f, 0, "DFM\x1a"))
+	{
+		return false;
+	}
+	f->seek(6);
+	unsigned long length = (unsigned long)f->readInt(1);
+	info.description = ReadText(f, 7, std::min(length, 32ul));
+	return true;
+}
+
+static bool ReadDTM(binistream *f, MusicInfo &info)
+{
+	if (!HasMagic(f, 0, "DeFy DTM "))
+	{
+		return false;
+	}
+	info.title = ReadText(f, 13, 20);
+	info.author = ReadText(f, 33, 20);
+	return true;
+}
+
+// Version 1 descriptions use 1 for a line break and 2 to 31 for that many spaces.
+static bool ReadRAD(binistream *f, MusicInfo &info)
+{
+	if (!HasMagic(f, 0, "RAD by REALiTY!!"))
+	{
+		return false;
+	}
+	f->seek(16);
+	unsigned char version = (unsigned char)f->readInt(1);
+	unsigned char flags = (unsigned char)f->readInt(1);
+	if (version != 0x10 || !(flags & 0x80))
+	{
+		return true;
+	}
+	for (unsigned long index = 0; index < 80 * 22; index++)
+	{
+		unsigned char value = (unsigned char)f->readInt(1);
+		if (f->error() || value == 0)
+		{
+			break;
+		}
+		if (value == 1)
+		{
+			info.description.push_back('\n');
+		}
+		else if (value < 32)
+		{
+			info.description.append(value, ' ');
+		}
+		else
+		{
+			info.description.push_back((char)value);
+		}
+	}
+	return true;
+}
+
+static bool ReadS3M(binistream *f, MusicInfo &info)
+{
+	if (!HasMagic(f, 44, "SCRM"))
+	{
+		return false;
+	}
+	info.title = ReadText(f, 0, 28);
+	return true;
+}
+
+static bool ReadSOP(binistream *f, MusicInfo &info)
+{
+	if (!HasMagic(f, 0, "sopepos"))
+	{
+		return false;
+	}
+	info.title = ReadText(f, 23, 31);
+	info.description = ReadText(f, 60, 13);
+	return true;
+}
+
+// The GD3 tag offset is relative to its own position in the header.
+bool ReadVGMTags(binistream *f, MusicInfo &info)
+{
+	if (!HasMagic(f, 0, "Vgm "))
+	{
+		return false;
+	}
+	f->seek(0x14);
+	unsigned long gd3Offset = (unsigned long)f->readInt(4);
+	if (gd3Offset == 0 || !HasMagic(f, 0x14 + gd3Offset, "Gd3 "))
+	{
+		return true;
+	}
+	// Skip the version and size.
+	f->ignore(8);
+	std::string tags[11];
+	for (std::string &tag : tags)
+	{
+		tag = ReadWideText(f);
+	}
+	info.title = tags[0];
+	info.author = tags[6];
+	info.description = tags[10];
+	return true;
+}
+
+// VGZ files are gzip-compressed VGM files.
+static bool ReadVGM(binistream *f, MusicInfo &info)
+{
+	if (InflateStream::IsGzip(f))
+	{
+		InflateStream inflater(f);
+		return inflater.isValid() && ReadVGMTags(&inflater, info);
+	}
+	return ReadVGMTags(f, info);
+}
+
+static bool ReadXAD(binistream *f, MusicInfo &info)
+{
+	if (!HasMagic(f, 0, "XAD!"))
+	{
+		return false;
+	}
+	info.title = ReadText(f, 4, 36);
+	info.author = ReadText(f, 40, 36);
+	return true;
+}
+
+// Header readers by player extension.
+struct HeaderReader
+{
+	const char *extension;
+	bool (*read)(binistream *f, MusicInfo &info);
+};
+
+static const HeaderReader headerReaders[] = {
+	{ ".amd", ReadAMD },
+	{ ".cmf", ReadCMF },
+	{ ".d00", ReadD00 },
+	{ ".dfm", ReadDFM },
+	{ ".dtm", ReadDTM },
+	{ ".rad", ReadRAD },
+	{ ".s3m", ReadS3M },
+	{ ".sop", ReadSOP },
+	{ ".vgm", ReadVGM },
+	{ ".xad", ReadXAD },
+};
+
+static bool ReadHeader(binistream *f, const CPlayerDesc *player, MusicInfo &info)
+{
+	const char *extension;
+	for (unsigned int index = 0; (extension = player->get_extension(index)) != NULL; index++)
+	{
+		for (const HeaderReader &reader : headerReaders)
+		{
+			if (_stricmp(extension, reader.extension) == 0)
+			{
+				MusicInfo header;
+				if (reader.read(f, header))
+				{
+					info = header;
+					return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+bool ProbeMusicHeader(binistream *f, const std::vector<const CPlayerDesc *> &players, MusicInfo &info)
+{
+	if (players.empty())
+	{
+		return false;
+	}
+	info = MusicInfo();
+	const CPlayerDesc *format = players.front();
+	for (const CPlayerDesc *player : players)
+	{
+		if (ReadHeader(f, player, info))
+		{
+			format = player;
+			break;
+		}
+	}
+	info.format = format->filetype;
+	f->seek(0);
+	f->error();
+	return true;
+}
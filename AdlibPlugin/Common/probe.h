@@ -0,0 +1,56 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+probe.h - Reads song metadata from file headers without loading a player.
+*/
+
+#ifndef _PROBE_H_
+#define _PROBE_H_
+#pragma once
+
+#include <string>
+#include <vector>
+#include "adplug.h"
+
+struct MusicInfo
+{
+	/*
+	The file type of the player that reads the file, as listed in its CPlayerDesc.
+	This names the format only.  GetMusicType reports the player's gettype, which can add a version or variant.
+	*/
+	std::string format;
+	std::string title;
+	std::string author;
+	std::string description;
+	// 0 when the header doesn't say.
+	int subsongs;
+	MusicInfo() : subsongs(0) {}
+};
+
+/*
+Fills in the song information using only the file header.  Patterns, events, and instruments are never decoded.
+players is the list of likely players for the file, best guess first.  The format comes from the first player
+with a header reader that accepts the file, or from the first player when none of the readers do.
+Returns false when there are no likely players.
+*/
+bool ProbeMusicHeader(binistream *f, const std::vector<const CPlayerDesc *> &players, MusicInfo &info);
+
+// Reads the GD3 tags of an uncompressed VGM file.  Returns false when it isn't a VGM file.
+bool ReadVGMTags(binistream *f, MusicInfo &info);
+
+#endif // _PROBE_H_
@@ -0,0 +1,130 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+quality.cpp - Trades emulator fidelity for render time under CPU pressure.
+*/
+
+#include "quality.h"
+#include "DllMain.h"
+
+// The emulators that can play each chip, best first.  0 ends a list.
+static const int opl2Steps[] = { OPL_NUKED, OPL_DOSBOX, OPL_SILVERMAN, 0 };
+static const int dualSteps[] = { OPL_DUAL, 0 };
+// The DOSBox emulator is built with OPL3 support.
+static const int opl3Steps[] = { OPL_NUKED, OPL_DOSBOX, 0 };
+
+static const int *GetSteps(Copl::ChipType chip)
+{
+	switch (chip)
+	{
+	case Copl::TYPE_OPL2:
+		return opl2Steps;
+	case Copl::TYPE_DUAL_OPL2:
+		return dualSteps;
+	default:
+		return opl3Steps;
+	}
+}
+
+void QualityScaler::setEnabled(bool value)
+{
+	enabled = value;
+	slowBuffers = 0;
+	fastBuffers = 0;
+	unavailable = 0;
+}
+
+void QualityScaler::start(int emulator, Copl::ChipType songChip)
+{
+	preferred = emulator;
+	chip = songChip;
+	slowBuffers = 0;
+	fastBuffers = 0;
+}
+
+int QualityScaler::findStep(int emulator) const
+{
+	const int *steps = GetSteps(chip);
+	for (int index = 0; steps[index]; index++)
+	{
+		if (steps[index] == emulator)
+		{
+			return index;
+		}
+	}
+	return -1;
+}
+
+int QualityScaler::update(int current, float load)
+{
+	int step = findStep(current);
+	int top = findStep(preferred);
+	if (!enabled || step < 0 || top < 0)
+	{
+		return 0;
+	}
+	if (load > QUALITY_HIGH_LOAD)
+	{
+		slowBuffers++;
+		fastBuffers = 0;
+	}
+	else if (load < QUALITY_LOW_LOAD)
+	{
+		fastBuffers++;
+		slowBuffers = 0;
+	}
+	else
+	{
+		slowBuffers = 0;
+		fastBuffers = 0;
+	}
+	const int *steps = GetSteps(chip);
+	if (slowBuffers >= QUALITY_DOWN_BUFFERS)
+	{
+		slowBuffers = 0;
+		for (int next = step + 1; steps[next]; next++)
+		{
+			if (isAvailable(steps[next]))
+			{
+				return steps[next];
+			}
+		}
+	}
+	if (fastBuffers >= QUALITY_UP_BUFFERS)
+	{
+		fastBuffers = 0;
+		for (int next = step - 1; next >= top; next--)
+		{
+			if (isAvailable(steps[next]))
+			{
+				return steps[next];
+			}
+		}
+	}
+	return 0;
+}
+
+bool QualityScaler::markUnavailable(int emulator)
+{
+	if (!isAvailable(emulator))
+	{
+		return false;
+	}
+	unavailable |= 1 << emulator;
+	return true;
+}
@@ -0,0 +1,77 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+quality.h - Trades emulator fidelity for render time under CPU pressure.
+*/
+
+#ifndef _QUALITY_H_
+#define _QUALITY_H_
+#pragma once
+
+#include "adplug.h"
+
+// The fraction of a buffer's play time that rendering it may take before the buffer counts as slow.
+#define QUALITY_HIGH_LOAD		0.25f
+// Below this fraction, a buffer counts as fast.
+#define QUALITY_LOW_LOAD		0.08f
+// Consecutive slow buffers before switching to a cheaper emulator.
+#define QUALITY_DOWN_BUFFERS	2
+// Consecutive fast buffers before switching back to a better emulator.  Much longer so that a spike doesn't cause flapping.
+#define QUALITY_UP_BUFFERS		50
+
+/*
+Picks the emulator to render with from how long rendering takes.
+Each chip has a list of the emulators that can play it, best first.  A run of slow buffers moves one step down the list,
+and a longer run of fast buffers moves one step back up, but never above the emulator that the song started on.
+*/
+class QualityScaler
+{
+public:
+	QualityScaler() :
+		enabled(false),
+		preferred(0),
+		chip(Copl::TYPE_OPL3),
+		slowBuffers(0),
+		fastBuffers(0),
+		unavailable(0)
+	{}
+	void setEnabled(bool value);
+	bool isEnabled() const { return enabled; }
+	// Sets the OPL_ emulator that a song starts on and the chip that the song needs.
+	void start(int emulator, Copl::ChipType songChip);
+	/*
+	Records the time taken to render a buffer as a fraction of its play time.
+	Returns the OPL_ emulator to switch to, or 0 to keep the current one.
+	*/
+	int update(int current, float load);
+	// Skips an OPL_ emulator that couldn't be created until scaling is enabled again.  Returns false if it was already skipped.
+	bool markUnavailable(int emulator);
+private:
+	// Where the emulator is in the list for the chip, or -1.
+	int findStep(int emulator) const;
+	bool isAvailable(int emulator) const { return (unavailable & (1 << emulator)) == 0; }
+	bool enabled;
+	int preferred;
+	Copl::ChipType chip;
+	int slowBuffers;
+	int fastBuffers;
+	// A bit for each OPL_ emulator that the pool failed to provide.
+	int unavailable;
+};
+
+#endif // _QUALITY_H_
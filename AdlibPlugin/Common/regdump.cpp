@@ -0,0 +1,775 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+regdump.cpp - Plays register dumps: DRO, IMF, and RAW files and songs compiled from other players.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "regdump.h"
+
+// The PIT clock that RAW delays count.
+#define RAW_CLOCK_RATE	1193180.0
+
+/*
+ADS files: the magic, the version, then the type, title, author, and description as length-prefixed strings.
+Then the initial refresh rate, the count and list of initial writes, the frame and write counts, the frames, and the writes.
+Each frame is a varint of its write count shifted left by 1, with the low bit set when its refresh rate follows.
+Frames without a refresh rate use the previous one.  Each write is a 16-bit register and an 8-bit value.
+All numbers are little-endian.  Refresh rates are 32-bit IEEE floats.
+*/
+static const char streamMagic[8] = { 'A', 'D', 'L', 'S', 'T', 'R', 'M', '\x1a' };
+static const unsigned long streamVersion = 1;
+
+const CPlayerDesc RegisterDumpPlayer::desc(RegisterDumpPlayer::factory, "Register Dump (indexed)", ".dro\0.imf\0.wlf\0.raw\0.ads\0");
+
+void RecordingOpl::write(int reg, int val)
+{
+	if (currChip == 1)
+	{
+		if (reg == 0x05 || reg == 0x04)
+		{
+			opl3Mode |= (val & (reg == 0x05 ? 0x01 : 0x3f)) != 0;
+		}
+		else if ((reg >= 0xb0 && reg <= 0xb8) || reg == 0xbd)
+		{
+			// Key-on, or rhythm mode.
+			secondChip |= (val & 0x20) != 0;
+		}
+	}
+	if (target)
+	{
+		target->chip = currChip;
+		target->addWrite(reg, val);
+	}
+}
+
+static unsigned long ReadLE(const std::vector<unsigned char> &file, unsigned long offset, int size)
+{
+	unsigned long value = 0;
+	for (int index = size - 1; index >= 0; index--)
+	{
+		value = (value << 8) | (offset + index < file.size() ? file[offset + index] : 0);
+	}
+	return value;
+}
+
+// Reads a null-terminated string of at most maxLength characters.  Moves the offset past the string and its null.
+static std::string ReadString(const std::vector<unsigned char> &file, unsigned long &offset, unsigned long maxLength)
+{
+	std::string text;
+	while (offset < file.size() && text.size() < maxLength)
+	{
+		char value = (char)file[offset++];
+		if (value == '\0')
+		{
+			break;
+		}
+		text.push_back(value);
+	}
+	return text;
+}
+
+bool RegisterDumpPlayer::load(const std::string &filename, const CFileProvider &fp)
+{
+	binistream *f = fp.open(filename);
+	if (!f)
+	{
+		return false;
+	}
+	// Read to the end instead of asking for the size, which not every stream reports the same way.
+	std::vector<unsigned char> file;
+	for (;;)
+	{
+		unsigned char value = (unsigned char)f->readInt(1);
+		if (f->eof())
+		{
+			break;
+		}
+		file.push_back(value);
+	}
+	fp.close(f);
+	bool loaded;
+	if (file.size() >= sizeof streamMagic && memcmp(file.data(), streamMagic, sizeof streamMagic) == 0)
+	{
+		// Stream files are complete.
+		if (!loadStream(file))
+		{
+			return false;
+		}
+		rewind(0);
+		return true;
+	}
+	if (file.size() >= 8 && memcmp(file.data(), "DBRAWOPL", 8) == 0)
+	{
+		loaded = loadDRO(file);
+	}
+	else if (file.size() >= 8 && memcmp(file.data(), "RAWADATA", 8) == 0)
+	{
+		loaded = loadRAW(file);
+	}
+	else
+	{
+		loaded = loadIMF(file, filename);
+	}
+	if (!loaded)
+	{
+		return false;
+	}
+	finishFrames(frames.empty() ? initialRefresh : frames.back().refresh);
+	rewind(0);
+	return true;
+}
+
+void RegisterDumpPlayer::readTags(const std::vector<unsigned char> &file, unsigned long offset, unsigned long authorLength)
+{
+	if (offset + 3 > file.size() || file[offset] != 0xff || file[offset + 1] != 0xff || file[offset + 2] != 0x1a)
+	{
+		return;
+	}
+	offset += 3;
+	title = ReadString(file, offset, 40);
+	if (offset < file.size() && file[offset] == 0x1b)
+	{
+		offset++;
+		author = ReadString(file, offset, authorLength);
+	}
+	if (offset < file.size() && file[offset] == 0x1c)
+	{
+		offset++;
+		description = ReadString(file, offset, 1023);
+	}
+}
+
+bool RegisterDumpPlayer::loadDRO(const std::vector<unsigned char> &file)
+{
+	unsigned long version = ReadLE(file, 8, 4);
+	if (version == 0x10000)
+	{
+		// v0.1: length in milliseconds, length in bytes, then the hardware type.
+		type = "DOSBox Raw OPL v0.1";
+		unsigned long length = ReadLE(file, 16, 4);
+		// The hardware type started as one byte and later became four without a version change.
+		unsigned long offset = 21;
+		if (file.size() >= 24 && (file[21] == 0 || file[22] == 0 || file[23] == 0))
+		{
+			offset = 24;
+		}
+		unsigned long end = std::min((unsigned long)file.size(), offset + length);
+		while (offset < end)
+		{
+			unsigned char command = file[offset++];
+			switch (command)
+			{
+			case 0x00:
+				addDelay((ReadLE(file, offset++, 1) + 1) / 1000.0);
+				break;
+			case 0x01:
+				addDelay((ReadLE(file, offset, 2) + 1) / 1000.0);
+				offset += 2;
+				break;
+			case 0x02:
+			case 0x03:
+				chip = command - 0x02;
+				break;
+			case 0x04:
+				// Escapes a register below 0x05.
+				addWrite(ReadLE(file, offset, 1), ReadLE(file, offset + 1, 1));
+				offset += 2;
+				break;
+			default:
+				addWrite(command, ReadLE(file, offset++, 1));
+				break;
+			}
+		}
+		readTags(file, end, 40);
+		return true;
+	}
+	if (version == 2)
+	{
+		type = "DOSBox Raw OPL v2.0";
+		unsigned long pairs = ReadLE(file, 12, 4);
+		// Only the interleaved, uncompressed format is defined.
+		if (file.size() < 26 || file[21] != 0 || file[22] != 0)
+		{
+			return false;
+		}
+		unsigned char shortDelay = file[23];
+		unsigned char longDelay = file[24];
+		unsigned long codemapLength = file[25];
+		if (codemapLength > 128 || 26 + codemapLength > file.size())
+		{
+			return false;
+		}
+		const unsigned char *codemap = file.data() + 26;
+		unsigned long offset = 26 + codemapLength;
+		for (unsigned long pair = 0; pair < pairs && offset + 2 <= file.size(); pair++, offset += 2)
+		{
+			unsigned char code = file[offset];
+			unsigned char value = file[offset + 1];
+			if (code == shortDelay)
+			{
+				addDelay((value + 1) / 1000.0);
+			}
+			else if (code == longDelay)
+			{
+				addDelay(((value + 1) << 8) / 1000.0);
+			}
+			else if ((code & 0x7f) < codemapLength)
+			{
+				chip = code >> 7;
+				addWrite(codemap[code & 0x7f], value);
+			}
+		}
+		readTags(file, offset, 40);
+		return true;
+	}
+	return false;
+}
+
+bool RegisterDumpPlayer::loadIMF(const std::vector<unsigned char> &file, const std::string &filename)
+{
+	unsigned long offset = 0;
+	// The size of the optional "ADLIB\1" header, plus 2 as AdPlug counts it.
+	unsigned long headerSize = 0;
+	std::string trackName;
+	std::string gameName;
+	if (file.size() >= 6 && memcmp(file.data(), "ADLIB\x01", 6) == 0)
+	{
+		offset = 6;
+		trackName = ReadString(file, offset, file.size());
+		gameName = ReadString(file, offset, file.size());
+		offset++;
+		headerSize = offset + 2;
+	}
+	else if (!CFileProvider::extension(filename, ".imf") && !CFileProvider::extension(filename, ".wlf"))
+	{
+		return false;
+	}
+	// An unterminated header string runs past the end of the file.  The size field has to follow it.
+	int sizeLength = headerSize ? 4 : 2;
+	if (offset > file.size() || file.size() - offset < (unsigned long)sizeLength)
+	{
+		return false;
+	}
+	type = "IMF File Format";
+	// Type 1 files start with the size of the music data.  Type 0 files are all music data.
+	unsigned long dataSize = ReadLE(file, offset, sizeLength);
+	unsigned long entries;
+	if (dataSize)
+	{
+		offset += sizeLength;
+		entries = dataSize / 4;
+	}
+	else
+	{
+		entries = file.size() > headerSize ? (unsigned long)(file.size() - headerSize) / 4 : 0;
+	}
+	entries = std::min(entries, (unsigned long)(file.size() - offset) / 4);
+	// id Software used 560 Hz for Commander Keen and 700 Hz for Wolfenstein 3-D.
+	float rate = CFileProvider::extension(filename, ".imf") ? 560.0f : 700.0f;
+	initialRefresh = rate;
+	initialWrites.push_back({ 0x01, 0x20 });
+	for (unsigned long entry = 0; entry < entries; entry++, offset += 4)
+	{
+		addWrite(file[offset], file[offset + 1]);
+		// The song ends after the last entry's writes, so its delay isn't part of the length.
+		if (entry + 1 < entries)
+		{
+			addDelay(ReadLE(file, offset + 2, 2) / rate);
+		}
+	}
+	title = trackName;
+	if (!gameName.empty())
+	{
+		title = title.empty() ? gameName : title + " - " + gameName;
+	}
+	if (dataSize && offset < file.size())
+	{
+		if (file[offset] == 0x1a)
+		{
+			// Adam Nielsen's footer: title, author, and remarks.
+			offset++;
+			title = ReadString(file, offset, file.size());
+			author = ReadString(file, offset, file.size());
+			description = ReadString(file, offset, file.size());
+		}
+		else
+		{
+			unsigned long footer = offset;
+			description = ReadString(file, footer, file.size());
+		}
+	}
+	return true;
+}
+
+bool RegisterDumpPlayer::loadRAW(const std::vector<unsigned char> &file)
+{
+	type = "Raw AdLib Capture";
+	unsigned long clock = ReadLE(file, 8, 2);
+	unsigned long speed = clock;
+	auto tickLength = [&speed]() { return (speed ? speed : 0xffff) / RAW_CLOCK_RATE; };
+	initialRefresh = (float)(1.0 / tickLength());
+	initialWrites.push_back({ 0x01, 0x20 });
+	unsigned long offset = 10;
+	for (; offset + 2 <= file.size(); offset += 2)
+	{
+		unsigned char param = file[offset];
+		unsigned char command = file[offset + 1];
+		if (command == 0)
+		{
+			// Waits param ticks.  0 waits 256.
+			addDelay((param ? param : 256) * tickLength());
+		}
+		else if (command == 2)
+		{
+			if (param == 0)
+			{
+				// The next pair is the new timer divisor.
+				offset += 2;
+				speed = ReadLE(file, offset, 2);
+			}
+			else
+			{
+				chip = param - 1;
+			}
+		}
+		else if (command == 0xff && param == 0xff)
+		{
+			break;
+		}
+		else
+		{
+			addWrite(command, param);
+		}
+	}
+	// Tags follow the end marker.
+	if (offset + 2 < file.size())
+	{
+		readTags(file, offset, 60);
+	}
+	return true;
+}
+
+void RegisterDumpPlayer::addWrite(int reg, int value)
+{
+	writes.push_back({ (unsigned short)((chip << 8) | (reg & 0xff)), (unsigned char)value });
+}
+
+void RegisterDumpPlayer::addDelay(double seconds)
+{
+	if (seconds <= 0)
+	{
+		return;
+	}
+	addFrameTime(seconds * 1000.0);
+}
+
+void RegisterDumpPlayer::addFrame(float frameRefresh)
+{
+	// An update with no refresh rate takes no time, so its writes join the next frame.
+	if (frameRefresh <= 0)
+	{
+		return;
+	}
+	addFrameTime(1000.0 / frameRefresh);
+}
+
+void RegisterDumpPlayer::addFrameTime(double ms)
+{
+	if (writes.size() == frameStart && !frames.empty())
+	{
+		// Nothing happened since the last frame, so it just lasts longer.  Playback only stops where there are writes.
+		Frame &last = frames.back();
+		frameTime += ms;
+		last.refresh = (float)(1000.0 / (frameTime - last.time));
+		return;
+	}
+	frames.push_back({ frameStart, (float)(1000.0 / ms), frameTime });
+	frameStart = (unsigned long)writes.size();
+	frameTime += ms;
+}
+
+void RegisterDumpPlayer::finishFrames(float lastRefresh)
+{
+	// The last update() makes any remaining writes and ends the song.
+	frames.push_back({ frameStart, lastRefresh, frameTime });
+	writes.shrink_to_fit();
+	frames.shrink_to_fit();
+	buildKeyframes();
+	findChipType();
+}
+
+void RegisterDumpPlayer::buildKeyframes()
+{
+	keyframes.clear();
+	RegisterImage image;
+	for (const RegisterWrite &write : initialWrites)
+	{
+		image.write(write.reg, write.value);
+	}
+	unsigned long collected = 0;
+	for (size_t index = 0; index < frames.size(); index++)
+	{
+		unsigned long first = frames[index].firstWrite;
+		if (first - collected >= KEYFRAME_WRITES)
+		{
+			for (; collected < first; collected++)
+			{
+				image.write(writes[collected].reg, writes[collected].value);
+			}
+			keyframes.push_back({ index, image });
+		}
+	}
+}
+
+void RegisterDumpPlayer::findChipType()
+{
+	bool secondChip = false;
+	bool opl3Mode = false;
+	auto check = [&](const RegisterWrite &write) {
+		if (write.reg == 0x105)
+		{
+			opl3Mode |= (write.value & 1) != 0;
+		}
+		else if (write.reg >= 0x100)
+		{
+			secondChip = true;
+		}
+	};
+	std::for_each(initialWrites.begin(), initialWrites.end(), check);
+	std::for_each(writes.begin(), writes.end(), check);
+	// OPL3 mode also changes the first register set, such as the waveforms and the output channels.
+	chipType = opl3Mode ? Copl::TYPE_OPL3 : secondChip ? Copl::TYPE_DUAL_OPL2 : Copl::TYPE_OPL2;
+}
+
+void RegisterDumpPlayer::writeRegisters(unsigned long first, unsigned long end, const std::vector<RegisterWrite> &list)
+{
+	for (unsigned long write = first; write < end; write++)
+	{
+		int writeChip = list[write].reg >> 8;
+		if (writeChip != chip)
+		{
+			chip = writeChip;
+			opl->setchip(chip);
+		}
+		opl->write(list[write].reg & 0xff, list[write].value);
+	}
+}
+
+bool RegisterDumpPlayer::update()
+{
+	writeRegisters(frames[frame].firstWrite, frame + 1 < frames.size() ? frames[frame + 1].firstWrite : (unsigned long)writes.size(), writes);
+	refresh = frames[frame].refresh;
+	frame++;
+	if (frame >= frames.size())
+	{
+		frame = 0;
+		return false;
+	}
+	return true;
+}
+
+void RegisterDumpPlayer::rewind(int)
+{
+	frame = 0;
+	refresh = initialRefresh;
+	opl->init();
+	chip = 0;
+	opl->setchip(0);
+	writeRegisters(0, (unsigned long)initialWrites.size(), initialWrites);
+}
+
+unsigned long RegisterDumpPlayer::getLength()
+{
+	return (unsigned long)frames.back().time;
+}
+
+void RegisterDumpPlayer::seekTo(unsigned long ms)
+{
+	rewind(0);
+	// Playing stops at the first frame that starts at or after the time, like CPlayer::seek.
+	auto it = std::lower_bound(frames.begin(), frames.end(), (double)ms, [](const Frame &f, double time) { return f.time < time; });
+	size_t target = std::min((size_t)(it - frames.begin()), frames.size() - 1);
+	if (target == 0)
+	{
+		return;
+	}
+	// Start from the last image at or before the frame.
+	RegisterImage image;
+	unsigned long first = 0;
+	auto keyframe = std::upper_bound(keyframes.begin(), keyframes.end(), target,
+		[](size_t frameIndex, const Keyframe &k) { return frameIndex < k.frame; });
+	if (keyframe != keyframes.begin())
+	{
+		--keyframe;
+		image = keyframe->image;
+		first = frames[keyframe->frame].firstWrite;
+	}
+	else
+	{
+		for (const RegisterWrite &write : initialWrites)
+		{
+			image.write(write.reg, write.value);
+		}
+	}
+	for (unsigned long write = first; write < frames[target].firstWrite; write++)
+	{
+		image.write(writes[write].reg, writes[write].value);
+	}
+	image.apply(opl);
+	chip = 0;
+	frame = target;
+	refresh = frames[target - 1].refresh;
+}
+
+bool RegisterDumpPlayer::compile(CPlayer *source, RecordingOpl &recorder, int subsong)
+{
+	type = source->gettype();
+	title = source->gettitle();
+	author = source->getauthor();
+	description = source->getdesc();
+	recorder.target = this;
+	source->rewind(subsong);
+	// What rewind writes is replayed by every rewind.
+	initialWrites.swap(writes);
+	initialRefresh = source->getrefresh();
+	bool ended = false;
+	while (frameTime <= COMPILE_MAX_LENGTH)
+	{
+		if (!source->update())
+		{
+			ended = true;
+			break;
+		}
+		addFrame(source->getrefresh());
+	}
+	if (ended)
+	{
+		finishFrames(source->getrefresh());
+	}
+	recorder.target = NULL;
+	source->rewind(subsong);
+	if (!ended)
+	{
+		writes.clear();
+		frames.clear();
+		initialWrites.clear();
+		frameStart = 0;
+		frameTime = 0;
+		return false;
+	}
+	rewind(0);
+	return true;
+}
+
+static void WriteUInt32(FILE *f, unsigned long value)
+{
+	unsigned char bytes[4] = { (unsigned char)value, (unsigned char)(value >> 8), (unsigned char)(value >> 16), (unsigned char)(value >> 24) };
+	fwrite(bytes, 1, sizeof bytes, f);
+}
+
+static void WriteString(FILE *f, const std::string &text)
+{
+	WriteUInt32(f, (unsigned long)text.size());
+	fwrite(text.c_str(), 1, text.size(), f);
+}
+
+static void WriteFloat(FILE *f, float value)
+{
+	unsigned int bits;
+	memcpy(&bits, &value, sizeof bits);
+	WriteUInt32(f, bits);
+}
+
+static void WriteVarint(FILE *f, unsigned long value)
+{
+	while (value >= 0x80)
+	{
+		fputc((int)(value & 0x7f) | 0x80, f);
+		value >>= 7;
+	}
+	fputc((int)value, f);
+}
+
+bool RegisterDumpPlayer::save(const std::string &path) const
+{
+	FILE *f = fopen(path.c_str(), "wb");
+	if (!f)
+	{
+		return false;
+	}
+	auto writeRegister = [f](const RegisterWrite &write) {
+		unsigned char bytes[3] = { (unsigned char)write.reg, (unsigned char)(write.reg >> 8), write.value };
+		fwrite(bytes, 1, sizeof bytes, f);
+	};
+	fwrite(streamMagic, 1, sizeof streamMagic, f);
+	WriteUInt32(f, streamVersion);
+	WriteString(f, type);
+	WriteString(f, title);
+	WriteString(f, author);
+	WriteString(f, description);
+	WriteFloat(f, initialRefresh);
+	WriteUInt32(f, (unsigned long)initialWrites.size());
+	for (const RegisterWrite &write : initialWrites)
+	{
+		writeRegister(write);
+	}
+	WriteUInt32(f, (unsigned long)frames.size());
+	WriteUInt32(f, (unsigned long)writes.size());
+	float previous = initialRefresh;
+	for (size_t index = 0; index < frames.size(); index++)
+	{
+		unsigned long end = index + 1 < frames.size() ? frames[index + 1].firstWrite : (unsigned long)writes.size();
+		bool changed = frames[index].refresh != previous;
+		WriteVarint(f, ((end - frames[index].firstWrite) << 1) | (changed ? 1 : 0));
+		if (changed)
+		{
+			WriteFloat(f, frames[index].refresh);
+			previous = frames[index].refresh;
+		}
+	}
+	for (const RegisterWrite &write : writes)
+	{
+		writeRegister(write);
+	}
+	bool success = !ferror(f);
+	fclose(f);
+	if (!success)
+	{
+		remove(path.c_str());
+	}
+	return success;
+}
+
+bool RegisterDumpPlayer::loadStream(const std::vector<unsigned char> &file)
+{
+	unsigned long offset = sizeof streamMagic;
+	bool valid = true;
+	auto readUInt32 = [&file, &offset, &valid]() {
+		if (offset + 4 > file.size())
+		{
+			valid = false;
+			return 0UL;
+		}
+		unsigned long value = ReadLE(file, offset, 4);
+		offset += 4;
+		return value;
+	};
+	auto readString = [&file, &offset, &valid, &readUInt32]() {
+		unsigned long length = readUInt32();
+		if (!valid || length > file.size() - offset)
+		{
+			valid = false;
+			return std::string();
+		}
+		std::string text((const char *)file.data() + offset, length);
+		offset += length;
+		return text;
+	};
+	auto readFloat = [&readUInt32]() {
+		unsigned int raw = (unsigned int)readUInt32();
+		float value;
+		memcpy(&value, &raw, sizeof value);
+		return value;
+	};
+	auto readVarint = [&file, &offset, &valid]() {
+		unsigned long value = 0;
+		for (int shift = 0; shift < 35; shift += 7)
+		{
+			if (offset >= file.size())
+			{
+				break;
+			}
+			unsigned char byte = file[offset++];
+			value |= (unsigned long)(byte & 0x7f) << shift;
+			if (!(byte & 0x80))
+			{
+				return value;
+			}
+		}
+		valid = false;
+		return 0UL;
+	};
+	auto readWrites = [&file, &offset, &valid](std::vector<RegisterWrite> &list, unsigned long count) {
+		if (!valid || count > (file.size() - offset) / 3)
+		{
+			valid = false;
+			return;
+		}
+		list.resize(count);
+		for (RegisterWrite &write : list)
+		{
+			write.reg = (unsigned short)(ReadLE(file, offset, 2) & 0x1ff);
+			write.value = file[offset + 2];
+			offset += 3;
+		}
+	};
+	if (readUInt32() != streamVersion)
+	{
+		return false;
+	}
+	type = readString();
+	title = readString();
+	author = readString();
+	description = readString();
+	initialRefresh = readFloat();
+	readWrites(initialWrites, readUInt32());
+	unsigned long frameCount = readUInt32();
+	unsigned long writeCount = readUInt32();
+	// Every frame takes at least a byte.
+	if (!valid || frameCount == 0 || frameCount > file.size() - offset)
+	{
+		return false;
+	}
+	frames.resize(frameCount);
+	float previous = initialRefresh;
+	unsigned long firstWrite = 0;
+	frameTime = 0;
+	for (Frame &f : frames)
+	{
+		unsigned long code = readVarint();
+		if (code & 1)
+		{
+			previous = readFloat();
+		}
+		if (!valid || previous <= 0)
+		{
+			return false;
+		}
+		f.firstWrite = firstWrite;
+		f.refresh = previous;
+		f.time = frameTime;
+		firstWrite += code >> 1;
+		frameTime += 1000.0 / previous;
+	}
+	if (firstWrite != writeCount)
+	{
+		return false;
+	}
+	readWrites(writes, writeCount);
+	// Anything left over means the file isn't the stream that its counts describe.
+	if (!valid || offset != file.size())
+	{
+		return false;
+	}
+	buildKeyframes();
+	findChipType();
+	return true;
+}
@@ -0,0 +1,172 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+regdump.h - Plays register dumps: DRO, IMF, and RAW files and songs compiled from other players.
+*/
+
+#ifndef _REGDUMP_H_
+#define _REGDUMP_H_
+#pragma once
+
+#include <vector>
+#include "adplug.h"
+#include "seekable.h"
+
+// The longest song that compile() records, the same limit as CPlayer::songlength.  Songs that don't end by then keep their original player.
+#define COMPILE_MAX_LENGTH	(10 * 60 * 1000)
+// The number of writes between the register images that seeking starts from.
+#define KEYFRAME_WRITES		16384
+
+class RegisterDumpPlayer;
+
+/*
+Records the register writes of another player for RegisterDumpPlayer::compile.  Create the player with this.
+Writes made before compile starts, such as while loading, are dropped.
+Every write is also checked for the chip it needs, so a recorder without a target can find a song's chip by playing part of it.
+*/
+class RecordingOpl : public Copl
+{
+public:
+	RecordingOpl(ChipType type) :
+		target(NULL),
+		opl3Mode(false),
+		secondChip(false)
+	{
+		currType = type;
+	}
+	void write(int reg, int val);
+	void init() {}
+	// The chip needed by the writes so far: OPL3 once 0x105 enables OPL3 mode or 0x104 sets up 4-op channels,
+	// dual OPL2 once the second chip plays a note.
+	ChipType getWrittenChip() const { return opl3Mode ? TYPE_OPL3 : secondChip ? TYPE_DUAL_OPL2 : TYPE_OPL2; }
+private:
+	friend class RegisterDumpPlayer;
+	RegisterDumpPlayer *target;
+	bool opl3Mode;
+	bool secondChip;
+};
+
+/*
+Plays DOSBox DRO v0.1 and v2.0, id Software IMF/WLF, RdosPlay RAW, and the plugin's own ADS stream files.
+Each file is parsed at load into a flat list of register writes split into frames, where a frame is the writes
+made by one update() followed by its delay.  Updates without writes only add to the delay of the frame before them.  Each frame also records its start time, so the song length
+is the start of the last frame and seeking finds its frame with a binary search.
+A register image is kept every KEYFRAME_WRITES writes, so seeking only collects the writes after the image before its frame.
+Any other player can be compiled into the same form by recording one play through, and the result saved as an ADS file.
+*/
+class RegisterDumpPlayer : public CPlayer, public SeekablePlayer
+{
+public:
+	static CPlayer *factory(Copl *newopl) { return new RegisterDumpPlayer(newopl); }
+	static const CPlayerDesc desc;
+
+	RegisterDumpPlayer(Copl *newopl) :
+		CPlayer(newopl),
+		chipType(Copl::TYPE_OPL2),
+		frameStart(0),
+		frameTime(0),
+		frame(0),
+		chip(0),
+		refresh(1000.0f),
+		initialRefresh(1000.0f)
+	{}
+
+	bool load(const std::string &filename, const CFileProvider &fp);
+	bool update();
+	void rewind(int subsong);
+	float getrefresh() { return refresh; }
+
+	std::string gettype() { return type; }
+	std::string gettitle() { return title; }
+	std::string getauthor() { return author; }
+	std::string getdesc() { return description; }
+
+	unsigned long getLength();
+	void seekTo(unsigned long ms);
+	// The least chip that plays every write: OPL3 if OPL3 mode is ever enabled, dual OPL2 if the second chip is written.
+	Copl::ChipType getChipType() const { return chipType; }
+
+	/*
+	Plays a subsong of the source player through once and keeps its writes and timing.  Only call this on a new player.
+	The source must have been created with the recorder and is rewound afterward.
+	Returns false if the subsong is longer than COMPILE_MAX_LENGTH.
+	*/
+	bool compile(CPlayer *source, RecordingOpl &recorder, int subsong);
+	// Writes an ADS file.
+	bool save(const std::string &path) const;
+private:
+	friend class RecordingOpl;
+	// Registers 0x100 and up are on the second chip.
+	struct RegisterWrite
+	{
+		unsigned short reg;
+		unsigned char value;
+	};
+	struct Frame
+	{
+		unsigned long firstWrite;
+		// The rate that update() reports after this frame's writes.
+		float refresh;
+		// In milliseconds from the start of the song.
+		double time;
+	};
+	// The registers before the frame's writes.
+	struct Keyframe
+	{
+		size_t frame;
+		RegisterImage image;
+	};
+	bool loadDRO(const std::vector<unsigned char> &file);
+	bool loadIMF(const std::vector<unsigned char> &file, const std::string &filename);
+	bool loadRAW(const std::vector<unsigned char> &file);
+	bool loadStream(const std::vector<unsigned char> &file);
+	// Reads the title, author, and description tags that DOSBox appends to DRO and RAW files.
+	void readTags(const std::vector<unsigned char> &file, unsigned long offset, unsigned long authorLength);
+	void addWrite(int reg, int value);
+	// Ends the current frame with the rate that update() reported.
+	void addFrame(float frameRefresh);
+	// Ends the current frame, or extends the last one when there were no writes since.
+	void addFrameTime(double ms);
+	// Ends the current frame when the delay isn't zero.  Writes with no delay between them share a frame.
+	void addDelay(double seconds);
+	// Adds the frame made by the last update().
+	void finishFrames(float lastRefresh);
+	void buildKeyframes();
+	void findChipType();
+	void writeRegisters(unsigned long first, unsigned long end, const std::vector<RegisterWrite> &list);
+
+	std::vector<RegisterWrite> writes;
+	std::vector<Frame> frames;
+	std::vector<Keyframe> keyframes;
+	Copl::ChipType chipType;
+	// Writes made by rewind() before the song starts.
+	std::vector<RegisterWrite> initialWrites;
+	unsigned long frameStart;
+	double frameTime;
+	// The next frame to play.
+	size_t frame;
+	int chip;
+	float refresh;
+	float initialRefresh;
+	std::string type;
+	std::string title;
+	std::string author;
+	std::string description;
+};
+
+#endif // _REGDUMP_H_
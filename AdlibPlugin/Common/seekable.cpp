@@ -0,0 +1,88 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+seekable.cpp - Exact song lengths and seeking without playing through the song.
+*/
+
+#include <string.h>
+#include "seekable.h"
+
+void RegisterImage::clear()
+{
+	memset(values, 0, sizeof values);
+	memset(written, 0, sizeof written);
+}
+
+static bool IsKeyRegister(int reg)
+{
+	reg &= 0xff;
+	return (reg >= 0xb0 && reg <= 0xb8) || reg == 0xbd;
+}
+
+void RegisterImage::apply(Copl *opl) const
+{
+	auto write = [this, opl](int reg) {
+		opl->setchip(reg >> 8);
+		opl->write(reg & 0xff, values[reg]);
+	};
+	// OPL3 mode and the 4-operator connections change how the other registers behave, so they go first.
+	static const int modeRegisters[] = { 0x105, 0x104, 0x001, 0x101 };
+	for (int reg : modeRegisters)
+	{
+		if (written[reg])
+		{
+			write(reg);
+		}
+	}
+	for (int reg = 0; reg < 512; reg++)
+	{
+		if (written[reg] && !IsKeyRegister(reg) && reg != 0x105 && reg != 0x104 && reg != 0x001 && reg != 0x101)
+		{
+			write(reg);
+		}
+	}
+	for (int reg = 0; reg < 512; reg++)
+	{
+		if (written[reg] && IsKeyRegister(reg))
+		{
+			write(reg);
+		}
+	}
+	opl->setchip(0);
+}
+
+unsigned long GetSongLength(CPlayer *player, int subsong)
+{
+	SeekablePlayer *seekable = dynamic_cast<SeekablePlayer *>(player);
+	if (seekable)
+	{
+		return seekable->getLength();
+	}
+	return player->songlength(subsong);
+}
+
+void SeekSong(CPlayer *player, unsigned long ms)
+{
+	SeekablePlayer *seekable = dynamic_cast<SeekablePlayer *>(player);
+	if (seekable)
+	{
+		seekable->seekTo(ms);
+		return;
+	}
+	player->seek(ms);
+}
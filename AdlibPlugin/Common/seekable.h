@@ -0,0 +1,68 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+seekable.h - Exact song lengths and seeking without playing through the song.
+*/
+
+#ifndef _SEEKABLE_H_
+#define _SEEKABLE_H_
+#pragma once
+
+#include "adplug.h"
+
+/*
+The last value written to each register.  Registers 0x100 and up are the second chip or the OPL3 high registers.
+*/
+class RegisterImage
+{
+public:
+	RegisterImage() { clear(); }
+	void clear();
+	void write(int reg, int value)
+	{
+		reg &= 0x1ff;
+		values[reg] = (unsigned char)value;
+		written[reg] = true;
+	}
+	// Writes every register that has been set to a freshly initialized chip in one burst.
+	// The key-on registers go last so that notes start with their final instrument settings.
+	void apply(Copl *opl) const;
+private:
+	unsigned char values[512];
+	bool written[512];
+};
+
+/*
+Implemented by the plugin's players for songs that are plain lists of timed register writes.
+Their timing is indexed at load, so the length is known without playing the song and seeking doesn't step through it.
+*/
+class SeekablePlayer
+{
+public:
+	virtual ~SeekablePlayer() {}
+	// In milliseconds.  Matches what CPlayer::songlength would return.
+	virtual unsigned long getLength() = 0;
+	// Rewinds and then moves to the given time, leaving the chip as it would be after playing up to that time.
+	virtual void seekTo(unsigned long ms) = 0;
+};
+
+// These use the player's index when it has one.  Otherwise they play through the song like AdPlug does.
+unsigned long GetSongLength(CPlayer *player, int subsong);
+void SeekSong(CPlayer *player, unsigned long ms);
+
+#endif // _SEEKABLE_H_
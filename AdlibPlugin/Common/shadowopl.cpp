@@ -0,0 +1,104 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+shadowopl.cpp - Drops register writes that wouldn't change the chip.
+*/
+
+#include "shadowopl.h"
+#include "seekable.h"
+
+// Writes that act on the chip each time they happen, even with the same value.
+static bool IsEdgeRegister(int reg)
+{
+	return (reg >= 0x02 && reg <= 0x04) || (reg >= 0xb0 && reg <= 0xb8) || reg == 0xbd;
+}
+
+/*
+Waveform writes don't all take effect.  DOSBox, Satoh and Ken Silverman's emulator ignore 0xE0-0xF5 while 0x01 bit 5 is clear,
+and Nuked masks waveforms 4 and up until OPL3 mode is enabled in 0x105.  So after either changes, a waveform write of the
+value last written could still change the sound.
+*/
+static bool IsWaveformModeRegister(int chip, int reg)
+{
+	return reg == 0x01 || (chip == 1 && reg == 0x05);
+}
+
+void ShadowOpl::write(int reg, int val)
+{
+	if (reg < 0 || reg > 0xff)
+	{
+		emulator->write(reg, val);
+		return;
+	}
+	short &shadow = registers[currChip][reg];
+	if (enabled && shadow == (val & 0xff) && !IsEdgeRegister(reg))
+	{
+		droppedWrites++;
+		return;
+	}
+	bool modeChanged = IsWaveformModeRegister(currChip, reg) && shadow != (val & 0xff);
+	shadow = (short)(val & 0xff);
+	emulator->write(reg, val);
+	if (modeChanged)
+	{
+		markWaveformsStale();
+	}
+}
+
+void ShadowOpl::setEmulator(Copl *newEmulator)
+{
+	RegisterImage image;
+	for (int chip = 0; chip < 2; chip++)
+	{
+		for (int reg = 0; reg < 256; reg++)
+		{
+			if (registers[chip][reg] >= 0)
+			{
+				image.write((chip << 8) | reg, registers[chip][reg] & 0xff);
+			}
+		}
+	}
+	emulator = newEmulator;
+	image.apply(emulator);
+	emulator->setchip(currChip);
+}
+
+void ShadowOpl::markWaveformsStale()
+{
+	for (int chip = 0; chip < 2; chip++)
+	{
+		for (int reg = 0xe0; reg <= 0xf5; reg++)
+		{
+			if (registers[chip][reg] >= 0)
+			{
+				registers[chip][reg] |= REGISTER_STALE;
+			}
+		}
+	}
+}
+
+void ShadowOpl::forget()
+{
+	for (int chip = 0; chip < 2; chip++)
+	{
+		for (int reg = 0; reg < 256; reg++)
+		{
+			registers[chip][reg] = -1;
+		}
+	}
+}
@@ -0,0 +1,82 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+shadowopl.h - Drops register writes that wouldn't change the chip.
+*/
+
+#ifndef _SHADOWOPL_H_
+#define _SHADOWOPL_H_
+#pragma once
+
+#include "adplug.h"
+
+// Set on a shadow register whose value is known but may not have taken effect, so the next write passes whatever its value.
+#define REGISTER_STALE	0x100
+
+/*
+Sits in front of an emulator and drops writes of the value a register already holds.
+Each chip has a shadow copy of its registers, which is forgotten whenever the chip is initialized.
+Key-on writes (0xB0-0xB8 and 0xBD) and timer writes (0x02-0x04) always pass, since writing the same value again can
+restart a note or a timer.  The waveform registers are marked stale when waveform select (0x01) or OPL3 mode (0x105) changes,
+since the emulators may have ignored the earlier waveform writes.
+*/
+class ShadowOpl : public Copl
+{
+public:
+	ShadowOpl(Copl *emulator) :
+		emulator(emulator),
+		enabled(true),
+		droppedWrites(0)
+	{
+		currType = emulator->gettype();
+		forget();
+	}
+	void write(int reg, int val);
+	void setchip(int n)
+	{
+		Copl::setchip(n);
+		emulator->setchip(n);
+	}
+	void init()
+	{
+		forget();
+		emulator->init();
+	}
+	void update(short *buf, int samples) { emulator->update(buf, samples); }
+	Copl *getEmulator() { return emulator; }
+	/*
+	Sends everything from now on to another emulator, which should have been initialized.  The type stays the same.
+	The registers written since the chip was last initialized are copied to the new emulator first, so a song carries on
+	where it was.  Notes that are on start again from their attack.
+	*/
+	void setEmulator(Copl *newEmulator);
+	// While disabled, every write passes.  The shadow registers are kept up to date either way.
+	void setEnabled(bool value) { enabled = value; }
+	// The number of writes dropped since the emulator was created.
+	unsigned long getDroppedWrites() const { return droppedWrites; }
+private:
+	void forget();
+	void markWaveformsStale();
+	Copl *emulator;
+	bool enabled;
+	unsigned long droppedWrites;
+	// -1 when the register hasn't been written since the chip was initialized.  May have REGISTER_STALE set.
+	short registers[2][256];
+};
+
+#endif // _SHADOWOPL_H_
@@ -0,0 +1,612 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+song.cpp - The source data and emulator connection of a song.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <binstr.h>
+#include "song.h"
+#include "lzss.h"
+#include "memusage.h"
+#include "regdump.h"
+#include "seekable.h"
+#include "vgmstream.h"
+
+// Reads a compressed source.  Only the block at the read position is unpacked.
+class SongBlockStream : public binistream
+{
+public:
+	SongBlockStream(const SongSource &source) :
+		source(source),
+		windowBlock(-1),
+		offset(0)
+	{
+		setFlag(binio::FloatIEEE);
+	}
+	void seek(long amount, Offset by = Set)
+	{
+		err &= ~Eof;
+		switch (by)
+		{
+		case Offset::Add:
+			offset += amount;
+			break;
+		case Offset::End:
+			offset = source.getFileSize() - amount;
+			break;
+		case Offset::Set:
+			offset = amount;
+			break;
+		}
+	}
+	long pos() { return offset; }
+protected:
+	binio::Byte getByte()
+	{
+		if (offset >= source.getFileSize())
+		{
+			err |= Eof;
+			return (Byte)EOF;
+		}
+		long block = (long)(offset / SONG_BLOCK_SIZE);
+		if (block != windowBlock)
+		{
+			source.unpackBlock(block, window);
+			windowBlock = block;
+		}
+		return window[offset++ % SONG_BLOCK_SIZE];
+	}
+private:
+	const SongSource &source;
+	unsigned char window[SONG_BLOCK_SIZE];
+	long windowBlock;
+	unsigned long offset;
+};
+
+void SongSource::read(binistream *f, bool compress)
+{
+	// Read to the end instead of asking for the size, which not every stream reports the same way.
+	std::vector<unsigned char> file;
+	unsigned long count;
+	f->seek(0);
+	do
+	{
+		file.resize(file.size() + SONG_BLOCK_SIZE);
+		count = f->readString((char *)file.data() + file.size() - SONG_BLOCK_SIZE, SONG_BLOCK_SIZE);
+		file.resize(file.size() - SONG_BLOCK_SIZE + count);
+	} while (count == SONG_BLOCK_SIZE);
+	size = (unsigned long)file.size();
+	compressed = compress;
+	data.clear();
+	blockOffsets.clear();
+	if (!compressed)
+	{
+		data.swap(file);
+		return;
+	}
+	std::vector<unsigned char> packed;
+	for (unsigned long start = 0; start < size; start += SONG_BLOCK_SIZE)
+	{
+		unsigned long blockSize = std::min(size - start, (unsigned long)SONG_BLOCK_SIZE);
+		blockOffsets.push_back((unsigned long)data.size());
+		if (lzss::compress(file.data() + start, blockSize, packed))
+		{
+			data.insert(data.end(), packed.begin(), packed.end());
+		}
+		else
+		{
+			data.insert(data.end(), file.begin() + start, file.begin() + start + blockSize);
+		}
+	}
+	blockOffsets.push_back((unsigned long)data.size());
+	data.shrink_to_fit();
+}
+
+bool SongSource::map(const std::string &path)
+{
+	MappedFile file;
+	if (!file.open(path))
+	{
+		return false;
+	}
+	size = file.size();
+	compressed = false;
+	data.clear();
+	blockOffsets.clear();
+	mappedPath = path;
+	return true;
+}
+
+bool SongSource::hasSameData(const SongSource &other) const
+{
+	if (size != other.size)
+	{
+		return false;
+	}
+	binistream *mine = open(filename);
+	binistream *theirs = other.open(other.filename);
+	bool same = mine && theirs;
+	std::vector<char> myBlock(SONG_BLOCK_SIZE);
+	std::vector<char> theirBlock(SONG_BLOCK_SIZE);
+	for (unsigned long start = 0; same && start < size; start += SONG_BLOCK_SIZE)
+	{
+		unsigned long blockSize = std::min(size - start, (unsigned long)SONG_BLOCK_SIZE);
+		same = mine->readString(myBlock.data(), blockSize) == blockSize && theirs->readString(theirBlock.data(), blockSize) == blockSize
+			&& memcmp(myBlock.data(), theirBlock.data(), blockSize) == 0;
+	}
+	if (mine)
+	{
+		close(mine);
+	}
+	if (theirs)
+	{
+		other.close(theirs);
+	}
+	return same;
+}
+
+unsigned long SongSource::unpackBlock(unsigned long block, unsigned char *output) const
+{
+	unsigned long start = block * SONG_BLOCK_SIZE;
+	unsigned long blockSize = std::min(size - start, (unsigned long)SONG_BLOCK_SIZE);
+	unsigned long packedSize = blockOffsets[block + 1] - blockOffsets[block];
+	const unsigned char *packed = data.data() + blockOffsets[block];
+	if (packedSize == blockSize)
+	{
+		memcpy(output, packed, blockSize);
+	}
+	else
+	{
+		lzss::decompress(packed, packedSize, output, blockSize);
+	}
+	return blockSize;
+}
+
+binistream *SongSource::open(std::string filename) const
+{
+	if (filename != this->filename)
+	{
+		std::lock_guard<std::recursive_mutex> guard(fallbackLock);
+		return fallback.open(filename);
+	}
+	std::lock_guard<std::mutex> guard(streamLock);
+	binistream *stream;
+	if (compressed)
+	{
+		stream = new SongBlockStream(*this);
+	}
+	else if (mappedPath.size())
+	{
+		// Fail if the file changed size on disk since it was loaded.
+		if (streams.empty() && (!mapping.open(mappedPath) || mapping.size() != size))
+		{
+			mapping.close();
+			return NULL;
+		}
+		stream = new binisstream((void *)mapping.data(), size);
+		stream->setFlag(binio::FloatIEEE);
+	}
+	else
+	{
+		stream = new binisstream(data.size() ? (void *)data.data() : NULL, (unsigned long)data.size());
+		stream->setFlag(binio::FloatIEEE);
+	}
+	streams.insert(stream);
+	return stream;
+}
+
+void SongSource::close(binistream *f) const
+{
+	{
+		std::lock_guard<std::mutex> guard(streamLock);
+		auto it = streams.find(f);
+		if (it != streams.end())
+		{
+			streams.erase(it);
+			delete f;
+			// Unmap once nothing is reading the file.
+			if (streams.empty())
+			{
+				mapping.close();
+			}
+			return;
+		}
+	}
+	std::lock_guard<std::recursive_mutex> guard(fallbackLock);
+	fallback.close(f);
+}
+
+CPlayer *LoadPlayer(const std::string &filename, const std::vector<const CPlayerDesc *> &candidates, Copl *opl,
+	const CFileProvider &provider, std::string &probes, const CPlayerDesc *&loadedBy)
+{
+	probes.clear();
+	loadedBy = NULL;
+	for (const CPlayerDesc *desc : candidates)
+	{
+		CPlayer *p = desc->factory(opl);
+		if (!p)
+		{
+			continue;
+		}
+		if (probes.size())
+		{
+			probes.append(",");
+		}
+		probes.append(desc->filetype);
+		bool loaded;
+		try
+		{
+			loaded = p->load(filename, provider);
+		}
+		catch (...)
+		{
+			delete p;
+			throw;
+		}
+		if (loaded)
+		{
+			loadedBy = desc;
+			return p;
+		}
+		delete p;
+	}
+	return NULL;
+}
+
+/*
+Trackers look up patterns, orders, and effects for every channel on every tick.
+The MIDI players parse variable-length deltas and running status from the raw file and walk every track on every tick.
+AdPlug is prebuilt, so their event data can't be decoded into arrays up front.  Compiling stands in for that: the stream
+holds the register writes that the events produce, in time order, and each tick only replays the writes that are due.
+The ROL player seeks by stepping through every tick of its per-voice event lists.  Compiled, a seek binary searches the
+stream's frames by time and rebuilds the chip from the nearest register image instead of replaying every tick.
+HERAD files are often packed, so they are unpacked on every load unless the compiled stream is cached.
+*/
+static bool IsExpensivePlayer(CPlayer *player)
+{
+	return dynamic_cast<CmodPlayer *>(player) || dynamic_cast<Cs3mPlayer *>(player)
+		|| dynamic_cast<CmidPlayer *>(player) || dynamic_cast<CcmfPlayer *>(player)
+		|| dynamic_cast<CrolPlayer *>(player) || dynamic_cast<CheradPlayer *>(player);
+}
+
+static bool ShouldCompile(CPlayer *player, PrecompileMode mode)
+{
+	if (mode == PRECOMPILE_NONE || player->getsubsongs() != 1 || dynamic_cast<SeekablePlayer *>(player))
+	{
+		return false;
+	}
+	return mode == PRECOMPILE_ALL || IsExpensivePlayer(player);
+}
+
+/*
+Records a loaded player through the song's OPL into a register stream.
+Returns NULL when the song doesn't end within COMPILE_MAX_LENGTH.
+*/
+static CPlayer *CompilePlayer(CPlayer *player, SongOpl &songOpl)
+{
+	RecordingOpl recorder(songOpl.gettype());
+	RegisterDumpPlayer *compiled = new RegisterDumpPlayer(&songOpl);
+	songOpl.setRecorder(&recorder);
+	bool success;
+	try
+	{
+		success = compiled->compile(player, recorder, -1);
+	}
+	catch (...)
+	{
+		songOpl.setRecorder(NULL);
+		delete compiled;
+		throw;
+	}
+	songOpl.setRecorder(NULL);
+	if (!success)
+	{
+		delete compiled;
+		return NULL;
+	}
+	return compiled;
+}
+
+// Plays the start of the default subsong into a recorder to see which chip it writes to, then rewinds it.
+static Copl::ChipType FindWrittenChip(CPlayer *player, SongOpl &songOpl)
+{
+	RecordingOpl recorder(songOpl.gettype());
+	songOpl.setRecorder(&recorder);
+	try
+	{
+		player->rewind();
+		double elapsed = 0;
+		while (elapsed < CHIP_DETECT_LENGTH && player->update())
+		{
+			elapsed += 1000.0 / player->getrefresh();
+		}
+		player->rewind();
+	}
+	catch (...)
+	{
+		// Assume the worst.  Playing the song will report the error.
+		songOpl.setRecorder(NULL);
+		return Copl::TYPE_OPL3;
+	}
+	songOpl.setRecorder(NULL);
+	return recorder.getWrittenChip();
+}
+
+SongData::~SongData()
+{
+	// A queued prefetch holds a reference, so it has always finished by now.
+	delete player;
+	delete source;
+}
+
+// Change this when compiling would record a song differently, so streams cached by older builds are ignored.
+#define STREAM_CACHE_VERSION	1
+
+/*
+Players can write differently depending on the chip they are given, so the emulator's chip type is part of the name,
+along with the cache version.
+*/
+std::string SongData::getStreamCachePath()
+{
+	char name[40];
+	snprintf(name, sizeof name, "%04x%08lx-%d-v%d.ads", (unsigned int)key.crc16, (unsigned long)key.crc32,
+		(int)songOpl.gettype(), STREAM_CACHE_VERSION);
+	return streamCache + name;
+}
+
+// Returns NULL when there's no cached stream for the content or it can't be read.
+CPlayer *SongData::loadCachedStream()
+{
+	if (streamCache.empty() || precompile == PRECOMPILE_NONE)
+	{
+		return NULL;
+	}
+	CProvider_Filesystem disk;
+	RegisterDumpPlayer *cached = new RegisterDumpPlayer(&songOpl);
+	if (!cached->load(getStreamCachePath(), disk))
+	{
+		delete cached;
+		return NULL;
+	}
+	// The original player wasn't loaded, so there's nothing for the format detector to remember.
+	loadProbes = RegisterDumpPlayer::desc.filetype;
+	loadedBy = NULL;
+	return cached;
+}
+
+void SongData::saveCachedStream()
+{
+	if (streamCache.empty())
+	{
+		return;
+	}
+	// Write to a temporary file first so that another load never reads a partial stream.
+	std::string path = getStreamCachePath();
+	std::string temporary = path + ".tmp";
+	if (!static_cast<RegisterDumpPlayer *>(player)->save(temporary))
+	{
+		return;
+	}
+	remove(path.c_str());
+	if (rename(temporary.c_str(), path.c_str()) != 0)
+	{
+		remove(temporary.c_str());
+	}
+}
+
+// Runs on the main thread or on the worker, holding the loader lock.
+void SongData::createPlayer()
+{
+	// Everything the player allocates while loading is charged to the song.
+	HeapUsageCounter allocated;
+	try
+	{
+		player = loadCachedStream();
+		if (!player)
+		{
+			player = LoadPlayer(source->getFilename(), candidates, &songOpl, *source, loadProbes, loadedBy);
+			if (player && ShouldCompile(player, precompile))
+			{
+				CPlayer *compiled = CompilePlayer(player, songOpl);
+				if (compiled)
+				{
+					delete player;
+					player = compiled;
+					saveCachedStream();
+				}
+			}
+		}
+		// Register streams and VGM files list every write, so they know.
+		if (RegisterDumpPlayer *stream = dynamic_cast<RegisterDumpPlayer *>(player))
+		{
+			requiredChip = stream->getChipType();
+		}
+		else if (VgmStreamPlayer *vgm = dynamic_cast<VgmStreamPlayer *>(player))
+		{
+			requiredChip = vgm->getChipType();
+		}
+		else if (player)
+		{
+			requiredChip = FindWrittenChip(player, songOpl);
+		}
+	}
+	catch (int e)
+	{
+		loadError.append("Error #").append(std::to_string(e));
+	}
+	catch (std::string e)
+	{
+		loadError.append(e);
+	}
+	catch (...)
+	{
+		loadError.append("Unknown error.");
+	}
+	if (!player && loadError.empty())
+	{
+		loadError.append("Failed to determine music file type.");
+	}
+	decodeFailed = (player == NULL);
+	decodedSize = player ? allocated.getBytes() : 0;
+}
+
+bool SongData::decode()
+{
+	if (decoded)
+	{
+		return true;
+	}
+	std::lock_guard<std::recursive_mutex> guard(loaderLock);
+	if (!player && !decodeFailed)
+	{
+		createPlayer();
+	}
+	if (!player)
+	{
+		return false;
+	}
+	// Writes made while loading were dropped.  From now on they go to the emulator.
+	songOpl.attach();
+	decoded = true;
+	return true;
+}
+
+void SongData::prefetch(BackgroundWorker &worker)
+{
+	if (decoded || prefetchQueued)
+	{
+		return;
+	}
+	prefetchQueued = true;
+	std::shared_ptr<SongData> self = shared_from_this();
+	worker.post([self]() {
+		{
+			// decode may have created the player, or failed to, while the job was queued.
+			std::lock_guard<std::recursive_mutex> guard(self->loaderLock);
+			if (!self->player && !self->decodeFailed)
+			{
+				self->createPlayer();
+			}
+		}
+		self->prefetchQueued = false;
+	});
+}
+
+void SongData::evict()
+{
+	if (!decoded)
+	{
+		return;
+	}
+	std::lock_guard<std::recursive_mutex> guard(loaderLock);
+	decoded = false;
+	delete player;
+	player = NULL;
+	decodedSize = 0;
+	songOpl.detach();
+}
+
+unsigned long SongData::getSongLength(int subsong)
+{
+	auto it = songLengths.find(subsong);
+	if (it != songLengths.end())
+	{
+		return it->second;
+	}
+	unsigned long length = 0;
+	if (dynamic_cast<SeekablePlayer *>(player))
+	{
+		// Indexed, so this doesn't move the player.
+		length = GetSongLength(player, subsong);
+	}
+	else
+	{
+		// Measuring plays the song through, which would move every song ID with this data, including one that's playing.
+		RecordingOpl silent(songOpl.gettype());
+		CPlayer *copy = createCopy(&silent);
+		if (copy)
+		{
+			// For ADL files, this will reset the OPL so that songlength(subsong) is accurate.
+			copy->rewind();
+			length = GetSongLength(copy, subsong);
+			delete copy;
+		}
+	}
+	songLengths[subsong] = length;
+	return length;
+}
+
+CPlayer *SongData::createCopy(Copl *opl)
+{
+	// Songs loaded from the stream cache are register streams, which never need a copy.
+	if (!loadedBy)
+	{
+		return NULL;
+	}
+	std::lock_guard<std::recursive_mutex> guard(loaderLock);
+	CPlayer *copy = loadedBy->factory(opl);
+	if (!copy)
+	{
+		return NULL;
+	}
+	bool loaded;
+	try
+	{
+		loaded = copy->load(source->getFilename(), *source);
+	}
+	catch (...)
+	{
+		loaded = false;
+	}
+	if (!loaded)
+	{
+		delete copy;
+		return NULL;
+	}
+	return copy;
+}
+
+bool SongData::exportStream(int subsong, const std::string &path)
+{
+	// Songs loaded from the stream cache are already a stream with one subsong.
+	if (!loadedBy)
+	{
+		return static_cast<RegisterDumpPlayer *>(player)->save(path);
+	}
+	RecordingOpl recorder(songOpl.gettype());
+	CPlayer *recording = createCopy(&recorder);
+	if (!recording)
+	{
+		return false;
+	}
+	bool saved = false;
+	try
+	{
+		RegisterDumpPlayer stream(&recorder);
+		saved = stream.compile(recording, recorder, subsong) && stream.save(path);
+	}
+	catch (...)
+	{
+		saved = false;
+	}
+	delete recording;
+	return saved;
+}
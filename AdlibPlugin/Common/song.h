@@ -0,0 +1,274 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+song.h - The source data and emulator connection of a song.
+*/
+
+#ifndef _SONG_H_
+#define _SONG_H_
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+#include "adplug.h"
+#include "mappedfile.h"
+#include "worker.h"
+
+/*
+Forwards a player's register writes to the emulator.
+Writes are dropped until the song is attached, so a player can be created on any thread without disturbing the music that is playing.
+*/
+class SongOpl : public Copl
+{
+public:
+	SongOpl(Copl *emulator) :
+		emulator(emulator),
+		target(NULL),
+		recorder(NULL)
+	{
+		currType = emulator->gettype();
+	}
+	void attach() { target = emulator; }
+	void detach() { target = NULL; }
+	// While set, everything goes to the recorder instead of the emulator.
+	void setRecorder(Copl *newRecorder) { recorder = newRecorder; }
+	void write(int reg, int val)
+	{
+		Copl *out = recorder ? recorder : target;
+		if (out)
+		{
+			out->write(reg, val);
+		}
+	}
+	void setchip(int n)
+	{
+		Copl::setchip(n);
+		Copl *out = recorder ? recorder : target;
+		if (out)
+		{
+			out->setchip(n);
+		}
+	}
+	void init()
+	{
+		Copl *out = recorder ? recorder : target;
+		if (out)
+		{
+			out->init();
+		}
+	}
+	// Renders from the emulator.  Nothing is rendered until the song is attached.
+	void update(short *buf, int samples)
+	{
+		if (target)
+		{
+			target->update(buf, samples);
+		}
+	}
+private:
+	Copl *emulator;
+	Copl *target;
+	Copl *recorder;
+};
+
+// Compressed sources are split into blocks of this size so a stream only has to unpack one block at a time.
+#define SONG_BLOCK_SIZE	16384
+// In milliseconds.  How much of a song decode plays to find the chip it needs.
+#define CHIP_DETECT_LENGTH	5000
+
+/*
+Keeps a song file available so that its player can be created at any time.
+Files on disk are mapped again whenever a stream is opened on them, so nothing is held between decodes.
+Anything else is copied.  The copy can be compressed, in which case streams unpack it one block at a time as the player reads.
+Other files that the player asks for, such as instrument banks, come from the fallback provider while holding the lock.
+*/
+class SongSource : public CFileProvider
+{
+public:
+	SongSource(const std::string &filename, const CFileProvider &fallback, std::recursive_mutex &fallbackLock) :
+		filename(filename),
+		size(0),
+		compressed(false),
+		fallback(fallback),
+		fallbackLock(fallbackLock)
+	{}
+	// Copies the whole stream, compressing it if requested.
+	void read(binistream *f, bool compress);
+	// Reads the file from disk instead of copying it.  Returns false if the file can't be mapped.
+	bool map(const std::string &path);
+	const std::string &getFilename() const { return filename; }
+	// The size of the file.
+	unsigned long getFileSize() const { return size; }
+	// The memory used to hold the file.  Mapped files don't count.
+	unsigned long getSize() const { return (unsigned long)data.size(); }
+	// Compares the content of the files, however each is held.
+	bool hasSameData(const SongSource &other) const;
+	// Unpacks a block of a compressed source.  Returns the size of the block.
+	unsigned long unpackBlock(unsigned long block, unsigned char *output) const;
+	binistream *open(std::string filename) const;
+	void close(binistream *f) const;
+private:
+	std::string filename;
+	unsigned long size;
+	bool compressed;
+	// The file, or the packed blocks when compressed.
+	std::vector<unsigned char> data;
+	// Where each packed block starts in data, plus the end.  Blocks that didn't get smaller are stored as-is.
+	std::vector<unsigned long> blockOffsets;
+	// The file on disk when the source is mapped instead of copied.
+	std::string mappedPath;
+	// Only open while there are streams.
+	mutable MappedFile mapping;
+	const CFileProvider &fallback;
+	std::recursive_mutex &fallbackLock;
+	// Streams over the song file.  Everything else came from the fallback.
+	mutable std::set<binistream *> streams;
+	// Songs are compared while another one is decoding on a worker thread.
+	mutable std::mutex streamLock;
+};
+
+// Which songs are compiled into register streams when decoded.  Only songs with one subsong can be.
+enum PrecompileMode
+{
+	PRECOMPILE_NONE,
+	PRECOMPILE_ALL,
+	// Only formats whose players do a lot of work on every tick.
+	PRECOMPILE_AUTO
+};
+
+/*
+Tries each player in turn until one loads the file.  Exceptions thrown by a player are passed on.
+probes receives the file types that were tried, separated by commas.  loadedBy receives the player that loaded the file.
+*/
+CPlayer *LoadPlayer(const std::string &filename, const std::vector<const CPlayerDesc *> &candidates, Copl *opl,
+	const CFileProvider &provider, std::string &probes, const CPlayerDesc *&loadedBy);
+
+/*
+The player for a song file and the source it's created from.  Song IDs loaded from identical files share one SongData.
+The player is created the first time decode is called, or on the background worker by prefetch.
+AdPlug's players aren't known to be safe to load side by side, so players are only created while holding the loader lock,
+whichever thread does it.  The plugin's file providers share that lock, so a load never waits on a thread that waits on it.
+A queued prefetch holds a reference to the data, so it is never waited on when the last song ID is deleted.
+*/
+class SongData : public std::enable_shared_from_this<SongData>
+{
+public:
+	SongData(SongSource *source, const std::vector<const CPlayerDesc *> &candidates, const CAdPlugDatabase::CKey &key, Copl *opl,
+		std::recursive_mutex &loaderLock) :
+		source(source),
+		candidates(candidates),
+		key(key),
+		songOpl(opl),
+		player(NULL),
+		loaderLock(loaderLock),
+		prefetchQueued(false),
+		decoded(false),
+		loadedBy(NULL),
+		decodeFailed(false),
+		precompile(PRECOMPILE_NONE),
+		decodedSize(0),
+		requiredChip(Copl::TYPE_OPL3),
+		lastUse(0)
+	{}
+	~SongData();
+	// Creates the player if it hasn't been already, waiting for a load in progress to finish.  Returns false if no player loads the song.
+	bool decode();
+	// Queues creating the player on the worker.  The data must be owned by a shared_ptr.
+	void prefetch(BackgroundWorker &worker);
+	// A player created by prefetch doesn't count until decode picks it up.
+	bool isDecoded() const { return decoded; }
+	// Deletes the player.  The source is kept so the song can be decoded again.
+	void evict();
+	// Only valid after a successful decode.
+	CPlayer *getPlayer() { return player; }
+	// The player's connection to the emulator.
+	Copl *getOpl() { return &songOpl; }
+	/*
+	The chip that the song needs.  Register streams and VGM files know theirs.  Other songs have the start of their default subsong
+	played into a recorder while decoding, so a song that only turns to OPL3 or the second chip after CHIP_DETECT_LENGTH is missed.
+	Only valid after a successful decode.
+	*/
+	Copl::ChipType getRequiredChip() const { return requiredChip; }
+	// Whether the other song file has the same content.
+	bool hasSameContent(const CAdPlugDatabase::CKey &otherKey, const SongSource &otherSource) const
+	{
+		return key.crc16 == otherKey.crc16 && key.crc32 == otherKey.crc32 && source->hasSameData(otherSource);
+	}
+	/*
+	In milliseconds.  Each subsong is only measured once.
+	Song IDs with this data share the player, so players that have to play the song through to measure it get a separate copy.
+	*/
+	unsigned long getSongLength(int subsong);
+	// Set before decoding.  Compiled songs are played from a register stream.
+	void setPrecompile(PrecompileMode mode) { precompile = mode; }
+	/*
+	Set before decoding.  Compiled songs are saved to the folder as ADS files named after the content key, chip type, and cache version.
+	When the folder already has one, it is loaded instead of the song, which skips unpacking and compiling.
+	An empty path disables the cache.
+	*/
+	void setStreamCache(const std::string &folder) { streamCache = folder; }
+	// Compiles a subsong into an ADS file.  Only valid after a successful decode.
+	bool exportStream(int subsong, const std::string &path);
+	const CAdPlugDatabase::CKey &getKey() const { return key; }
+	const std::string &getFilename() const { return source->getFilename(); }
+	// The error from a failed decode.
+	const std::string &getLoadError() const { return loadError; }
+	// The file types of the players that decode tried, separated by commas.
+	const std::string &getLoadProbes() const { return loadProbes; }
+	const CPlayerDesc *getLoadedBy() const { return loadedBy; }
+	// An estimate of the bytes allocated while creating the player, or 0 if not decoded.
+	unsigned long getDecodedSize() { return isDecoded() ? decodedSize : 0; }
+	unsigned long getSourceSize() const { return source->getSize(); }
+	// Least recently used songs are evicted first.
+	unsigned long long getLastUse() const { return lastUse; }
+	void setLastUse(unsigned long long use) { lastUse = use; }
+private:
+	void createPlayer();
+	// Loads another player for the song on the given OPL, or returns NULL.  Only valid after a successful decode.
+	CPlayer *createCopy(Copl *opl);
+	std::string getStreamCachePath();
+	CPlayer *loadCachedStream();
+	void saveCachedStream();
+	SongSource *source;
+	std::vector<const CPlayerDesc *> candidates;
+	CAdPlugDatabase::CKey key;
+	SongOpl songOpl;
+	CPlayer *player;
+	std::recursive_mutex &loaderLock;
+	std::atomic<bool> prefetchQueued;
+	// Set by decode on the main thread.  Until then, the player belongs to whichever thread holds the loader lock.
+	bool decoded;
+	std::string loadError;
+	std::string loadProbes;
+	const CPlayerDesc *loadedBy;
+	bool decodeFailed;
+	PrecompileMode precompile;
+	// The folder that compiled songs are saved to, ending with a separator.
+	std::string streamCache;
+	unsigned long decodedSize;
+	Copl::ChipType requiredChip;
+	unsigned long long lastUse;
+	// Song lengths by subsong.  Kept through eviction.
+	std::map<int, unsigned long> songLengths;
+};
+
+#endif // _SONG_H_
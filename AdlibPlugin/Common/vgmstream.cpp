@@ -0,0 +1,304 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+vgmstream.cpp - Plays VGM files while reading them.
+*/
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "vgmstream.h"
+
+const CPlayerDesc VgmStreamPlayer::desc(VgmStreamPlayer::factory, "Video Game Music (streamed)", ".vgm\0.vgz\0");
+
+bool VgmStreamPlayer::load(const std::string &filename, const CFileProvider &fp)
+{
+	file = fp.open(filename);
+	if (!file)
+	{
+		return false;
+	}
+	provider = &fp;
+	if (InflateStream::IsGzip(file))
+	{
+		inflater = new InflateStream(file);
+		stream = inflater;
+	}
+	else
+	{
+		stream = file;
+	}
+	stream->seek(0);
+	char magic[4];
+	if (stream->readString(magic, sizeof magic) != sizeof magic || memcmp(magic, VGM_HEADER_ID, sizeof magic) != 0)
+	{
+		close();
+		return false;
+	}
+	endOffset = OFFSET_EOF + (unsigned long)stream->readInt(4);
+	version = (unsigned long)stream->readInt(4);
+	stream->seek(OFFSET_LOOP);
+	unsigned long loop = (unsigned long)stream->readInt(4);
+	loopOffset = loop ? OFFSET_LOOP + loop : 0;
+	// Versions before 1.50 always start the data at 0x40.
+	stream->seek(OFFSET_DATA);
+	unsigned long data = (unsigned long)stream->readInt(4);
+	dataOffset = version >= 0x150 && data ? OFFSET_DATA + data : 0x40;
+	// The chip clocks are only in the header when the data starts after them.
+	unsigned long ym3812 = 0;
+	unsigned long ymf262 = 0;
+	if (version >= 0x151 && dataOffset >= OFFSET_YM3812 + 4)
+	{
+		stream->seek(OFFSET_YM3812);
+		ym3812 = (unsigned long)stream->readInt(4);
+	}
+	if (version >= 0x151 && dataOffset >= OFFSET_YMF262 + 4)
+	{
+		stream->seek(OFFSET_YMF262);
+		ymf262 = (unsigned long)stream->readInt(4);
+	}
+	if (stream->error() || (!ym3812 && !ymf262))
+	{
+		close();
+		return false;
+	}
+	// Some rippers leave the end of file offset empty.
+	if (endOffset <= dataOffset)
+	{
+		endOffset = ULONG_MAX;
+	}
+	opl3 = ymf262 != 0;
+	dual = !opl3 && (ym3812 & VGM_DUAL_BIT) != 0;
+	ReadVGMTags(stream, info);
+	buildIndex();
+	rewind(0);
+	return true;
+}
+
+void VgmStreamPlayer::close()
+{
+	delete inflater;
+	inflater = NULL;
+	if (file)
+	{
+		provider->close(file);
+		file = NULL;
+	}
+	stream = NULL;
+}
+
+void VgmStreamPlayer::write(RegisterImage *image, int chip, int reg, int value)
+{
+	if (image)
+	{
+		image->write((chip << 8) | reg, value);
+		return;
+	}
+	opl->setchip(chip);
+	opl->write(reg, value);
+}
+
+void VgmStreamPlayer::buildIndex()
+{
+	stream->seek(dataOffset);
+	stream->error();
+	RegisterImage image;
+	unsigned long long samples = 0;
+	checkpoints.push_back({ dataOffset, 0, image });
+	while (readCommands(&image))
+	{
+		samples += wait;
+		if (samples >= checkpoints.back().samples + VGM_CHECKPOINT_SAMPLES)
+		{
+			checkpoints.push_back({ (unsigned long)stream->pos(), samples, image });
+		}
+	}
+	totalSamples = samples;
+}
+
+unsigned long VgmStreamPlayer::getLength()
+{
+	return (unsigned long)(totalSamples * 1000 / VGM_FREQUENCY);
+}
+
+void VgmStreamPlayer::seekTo(unsigned long ms)
+{
+	rewind(0);
+	unsigned long long target = (unsigned long long)(ms * VGM_FREQUENCY / 1000);
+	if (target == 0)
+	{
+		return;
+	}
+	auto it = std::upper_bound(checkpoints.begin(), checkpoints.end(), target,
+		[](unsigned long long samples, const Checkpoint &checkpoint) { return samples < checkpoint.samples; });
+	const Checkpoint &checkpoint = *(it - 1);
+	RegisterImage image = checkpoint.image;
+	stream->seek(checkpoint.offset);
+	stream->error();
+	// Stop at the first wait that reaches the time, like CPlayer::seek.
+	unsigned long long samples = checkpoint.samples;
+	while (samples < target && readCommands(&image))
+	{
+		samples += wait;
+	}
+	image.apply(opl);
+}
+
+bool VgmStreamPlayer::update()
+{
+	if (readCommands(NULL))
+	{
+		return !songend;
+	}
+	songend = true;
+	if (loopOffset)
+	{
+		stream->seek(loopOffset);
+		stream->error();
+		if (readCommands(NULL))
+		{
+			return false;
+		}
+	}
+	// Stay at the end.  Keep a sensible refresh rate for whoever keeps calling.
+	wait = 735;
+	return false;
+}
+
+bool VgmStreamPlayer::readCommands(RegisterImage *image)
+{
+	wait = 0;
+	while (!wait)
+	{
+		int command = (int)stream->readInt(1);
+		if (stream->eof() || command == CMD_DATA_END || (unsigned long)stream->pos() > endOffset)
+		{
+			return false;
+		}
+		switch (command)
+		{
+		case CMD_OPL2:
+		case CMD_OPL3_PORT0:
+		{
+			int reg = (int)stream->readInt(1);
+			write(image, 0, reg, (int)stream->readInt(1));
+			break;
+		}
+		case CMD_OPL3_PORT1:
+		{
+			int reg = (int)stream->readInt(1);
+			if (opl3)
+			{
+				write(image, 1, reg, (int)stream->readInt(1));
+			}
+			else
+			{
+				stream->ignore();
+			}
+			break;
+		}
+		case CMD_OPL2_2ND:
+		{
+			int reg = (int)stream->readInt(1);
+			if (dual)
+			{
+				write(image, 1, reg, (int)stream->readInt(1));
+			}
+			else
+			{
+				stream->ignore();
+			}
+			break;
+		}
+		case CMD_WAIT:
+			wait = (unsigned int)stream->readInt(2);
+			break;
+		case CMD_WAIT_735:
+			wait = 735;
+			break;
+		case CMD_WAIT_882:
+			wait = 882;
+			break;
+		case 0x67:
+			// Data block: 0x66, type, then a 32-bit size.
+			stream->ignore(2);
+			stream->ignore((unsigned long)stream->readInt(4));
+			break;
+		case 0x68:
+			stream->ignore(11);
+			break;
+		default:
+			// Commands for other chips.  Only their lengths matter.
+			if (command >= CMD_WAIT_N && command <= CMD_WAIT_N + 0x0f)
+			{
+				wait = (command & 0x0f) + 1;
+			}
+			else if (command >= 0x80 && command <= 0x8f)
+			{
+				// YM2612 DAC write and wait.
+				wait = command & 0x0f;
+			}
+			else if (command >= 0x30 && command <= 0x3f)
+			{
+				stream->ignore(1);
+			}
+			else if (command == 0x4f || command == 0x50)
+			{
+				stream->ignore(1);
+			}
+			else if ((command >= 0x40 && command <= 0x4e) || (command >= 0x51 && command <= 0x5f) || (command >= 0xa0 && command <= 0xbf))
+			{
+				stream->ignore(2);
+			}
+			else if (command >= 0xc0 && command <= 0xdf)
+			{
+				stream->ignore(3);
+			}
+			else if (command >= 0xe0)
+			{
+				stream->ignore(4);
+			}
+			else if (command >= 0x90 && command <= 0x95)
+			{
+				static const unsigned long streamCommandSizes[] = { 4, 4, 5, 10, 1, 4 };
+				stream->ignore(streamCommandSizes[command - 0x90]);
+			}
+			break;
+		}
+	}
+	return true;
+}
+
+void VgmStreamPlayer::rewind(int)
+{
+	stream->seek(dataOffset);
+	stream->error();
+	songend = false;
+	wait = 0;
+	opl->init();
+	opl->setchip(0);
+}
+
+std::string VgmStreamPlayer::gettype()
+{
+	char type[64];
+	snprintf(type, sizeof type, "Video Game Music %x.%02x (%s%s)", (unsigned int)(version >> 8), (unsigned int)(version & 0xff),
+		opl3 ? "OPL3" : dual ? "Dual OPL2" : "OPL2", inflater ? ", compressed" : "");
+	return type;
+}
@@ -0,0 +1,109 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+vgmstream.h - Plays VGM files while reading them.
+*/
+
+#ifndef _VGMSTREAM_H_
+#define _VGMSTREAM_H_
+#pragma once
+
+#include "adplug.h"
+#include "inflate.h"
+#include "probe.h"
+#include "seekable.h"
+#include "../AdPlug/src/vgm.h"
+
+// How much song time there is between the points that seeking starts from.
+#define VGM_CHECKPOINT_SAMPLES	(10 * 44100)
+
+/*
+Plays YM3812 and YMF262 VGM files, including gzip-compressed VGZ files, without loading the command data into memory.
+The file stays open while the player exists and commands are read as update() reaches them.
+Compressed files are decompressed as they play.  Rewinding and looping seek the stream, which uses its checkpoints.
+The commands are read once at load to find the length and to record the register image every VGM_CHECKPOINT_SAMPLES.
+Seeking starts from the checkpoint before the time and collects the writes from there without playing them.
+*/
+class VgmStreamPlayer : public CPlayer, public SeekablePlayer
+{
+public:
+	static CPlayer *factory(Copl *newopl) { return new VgmStreamPlayer(newopl); }
+	static const CPlayerDesc desc;
+
+	VgmStreamPlayer(Copl *newopl) :
+		CPlayer(newopl),
+		provider(NULL),
+		file(NULL),
+		inflater(NULL),
+		stream(NULL),
+		songend(false),
+		wait(0),
+		totalSamples(0)
+	{}
+	~VgmStreamPlayer() { close(); }
+
+	bool load(const std::string &filename, const CFileProvider &fp);
+	bool update();
+	void rewind(int subsong);
+	float getrefresh() { return (float)(VGM_FREQUENCY / (wait ? wait : 735)); }
+
+	std::string gettype();
+	std::string gettitle() { return info.title; }
+	std::string getauthor() { return info.author; }
+	std::string getdesc() { return info.description; }
+
+	unsigned long getLength();
+	void seekTo(unsigned long ms);
+	// The chip named by the header.
+	Copl::ChipType getChipType() const { return opl3 ? Copl::TYPE_OPL3 : dual ? Copl::TYPE_DUAL_OPL2 : Copl::TYPE_OPL2; }
+private:
+	struct Checkpoint
+	{
+		unsigned long offset;
+		unsigned long long samples;
+		RegisterImage image;
+	};
+	void close();
+	void buildIndex();
+	// Reads commands up to the next wait.  Returns false at the end of the data.
+	// Writes go into the image when there is one, otherwise to the chip.
+	bool readCommands(RegisterImage *image);
+	void write(RegisterImage *image, int chip, int reg, int value);
+
+	const CFileProvider *provider;
+	binistream *file;
+	InflateStream *inflater;
+	// The VGM data.  This is the inflater for compressed files.
+	binistream *stream;
+	unsigned long version;
+	unsigned long endOffset;
+	unsigned long dataOffset;
+	// 0 when the song doesn't loop.
+	unsigned long loopOffset;
+	bool opl3;
+	bool dual;
+	MusicInfo info;
+	bool songend;
+	// Samples until the next command.
+	unsigned int wait;
+	// Up to the end of the data, not counting the loop.
+	unsigned long long totalSamples;
+	std::vector<Checkpoint> checkpoints;
+};
+
+#endif // _VGMSTREAM_H_
@@ -0,0 +1,53 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+worker.cpp - Runs background jobs one at a time.
+*/
+
+#include <thread>
+#include "worker.h"
+
+void BackgroundWorker::post(std::function<void()> job)
+{
+	std::lock_guard<std::mutex> guard(queue->lock);
+	queue->jobs.push_back(job);
+	if (!queue->running)
+	{
+		queue->running = true;
+		std::thread(&BackgroundWorker::run, queue).detach();
+	}
+}
+
+void BackgroundWorker::run(std::shared_ptr<Queue> queue)
+{
+	for (;;)
+	{
+		std::function<void()> job;
+		{
+			std::lock_guard<std::mutex> guard(queue->lock);
+			if (queue->jobs.empty())
+			{
+				queue->running = false;
+				return;
+			}
+			job = queue->jobs.front();
+			queue->jobs.pop_front();
+		}
+		job();
+	}
+}
@@ -0,0 +1,56 @@
+/*
+AdlibPlugin - AppGameKit Plugin to play OPL2/3 files using AdPlug.
+Copyright (c) 2019 Adam Biser <adambiser@gmail.com>
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+worker.h - Runs background jobs one at a time.
+*/
+
+#ifndef _WORKER_H_
+#define _WORKER_H_
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+/*
+Runs jobs in the order they are posted on a single background thread.
+The thread is started when a job is posted and exits once the queue is empty, so it's never joined.
+It holds the queue through a shared_ptr, so a job that's running when the worker is destroyed finishes safely.
+Copies post to the same queue, so a job can keep a copy to queue more work.
+*/
+class BackgroundWorker
+{
+public:
+	BackgroundWorker() :
+		queue(std::make_shared<Queue>())
+	{}
+	void post(std::function<void()> job);
+private:
+	struct Queue
+	{
+		Queue() : running(false) {}
+		std::mutex lock;
+		std::deque<std::function<void()>> jobs;
+		bool running;
+	};
+	static void run(std::shared_ptr<Queue> queue);
+	std::shared_ptr<Queue> queue;
+};
+
+#endif // _WORKER_H_